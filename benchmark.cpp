@@ -0,0 +1,376 @@
+// ==========================================================================
+// CPU benchmark of the geometry generators, no OpenGL context is needed.
+//
+// For every generator and level it prints the time per generated vertex
+// (best of several builds), the heap allocations made by one build and the
+// peak heap memory held during it, as CSV on standard output.
+// ==========================================================================
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "geometry.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// Heap accounting: every allocation is prefixed with its size so that the
+// bytes in use can be followed through new and delete
+
+const size_t ALLOCATION_HEADER = 16;    // keeps the returned memory aligned for SSE and AVX loads
+atomic<long long> allocations(0);
+atomic<long long> heapBytes(0);
+atomic<long long> peakHeapBytes(0);
+
+// Allocation and release behind every form of new and delete. They are kept out of line so the
+// compiler never sees the header arithmetic on a pointer it knows came from new, which -Wall reports
+// as out of bounds and mismatched with free
+__attribute__((noinline)) void *CountedAllocate(size_t size)
+{
+    char *block = (char *)malloc(size + ALLOCATION_HEADER);
+    if (block == 0)
+    {
+        return 0;
+    }
+    *(size_t *)block = size;
+    allocations++;
+    long long inUse = heapBytes += size;
+    long long peak = peakHeapBytes;
+    while (inUse > peak && !peakHeapBytes.compare_exchange_weak(peak, inUse))
+    {}
+    return block + ALLOCATION_HEADER;
+}
+
+__attribute__((noinline)) void CountedFree(void *memory)
+{
+    if (memory == 0)
+    {
+        return;
+    }
+    char *block = (char *)memory - ALLOCATION_HEADER;
+    heapBytes -= *(size_t *)block;
+    free(block);
+}
+
+// The plain, array, nothrow and sized forms are replaced as a set, so memory from any new is released
+// by the matching delete whichever form the compiler picks
+void *operator new(size_t size)
+{
+    void *memory = CountedAllocate(size);
+    if (memory == 0)
+    {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    CountedFree(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    CountedFree(memory);
+}
+
+void operator delete(void *memory, const nothrow_t &) noexcept
+{
+    CountedFree(memory);
+}
+
+void operator delete[](void *memory, const nothrow_t &) noexcept
+{
+    CountedFree(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    CountedFree(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    CountedFree(memory);
+}
+
+// --------------------------------------------------------------------------
+// Builds of each generator, returning the number of vertices generated. Like
+// main.cpp without mapped buffers each build allocates its own arrays
+
+long long BuildSquareAndDiamond(int level)
+{
+    vector<float> vertices(SquareAndDiamondVertexCount(level) * 2);
+    vector<float> colours(vertices.size() / 2 * 3);
+    SetupVertexBufferSquareAndDiamond(0, level, vertices.data(), false);
+    SetupColourBufferSquareAndDiamond(0, level, colours.data(), false);
+    return vertices.size() / 2;
+}
+
+// The corners of the square and diamond once each, with the indices drawing them
+long long BuildSquareAndDiamondIndexed(int level)
+{
+    long long count = SquareAndDiamondIndexedVertexCount(level);
+    int indexBytes = IndexBytes(count);
+    vector<float> vertices(count * 2);
+    vector<float> colours(count * 3);
+    vector<char> indices(SquareAndDiamondVertexCount(level) * indexBytes);
+    SetupVertexBufferSquareAndDiamond(0, level, vertices.data(), true);
+    SetupColourBufferSquareAndDiamond(0, level, colours.data(), true);
+    SetupIndexBufferSquareAndDiamond(0, level, indices.data(), indexBytes);
+    return count;
+}
+
+long long BuildSpiral(int level)
+{
+    vector<float> vertices(SpiralSampleCount(level) * 4);
+    vector<float> colours(vertices.size() / 2 * 3);
+    EvaluateSpiral(vertices.data(), level);
+    AssignSpiralColours(colours.data(), level, 0);
+    return vertices.size() / 2;
+}
+
+// The stacked spiral the program first generated. It counts the vertices of its visible last copy, the
+// spiral BuildSpiral() makes, so the time per vertex of the two rows compares old and new directly
+long long BuildStackedSpiral(int level)
+{
+    vector<float> vertices, colours;
+    StackedSpiralReference(level, &vertices, &colours);
+    return vertices.size() / 2 / level;
+}
+
+// Spiral sampled for a 512 pixel window, as main.cpp does by default
+long long BuildAdaptiveSpiral(int level)
+{
+    vector<float> samples;
+    AdaptiveSpiralSamples(level, 256.0f, 0.7f, &samples);
+    vector<float> vertices(samples.size() * 4);
+    vector<float> colours(samples.size() * 6);
+    EvaluateSpiralSamples(vertices.data(), samples.data(), samples.size(), level);
+    AssignSpiralSampleColours(colours.data(), samples.data(), samples.size(), level);
+    return vertices.size() / 2;
+}
+
+// Only the vertices of the Sierpinski triangle, on one thread
+long long BuildSierpinskiVertices(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_VERTEX_FLOATS * sizeof(float));
+    vector<float> vertices(groups * SIERPINSKI_VERTEX_FLOATS);
+    renderTriangleLevel(vertices.data(), 0, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, 1, level, false, 0);
+    return groups * SIERPINSKI_VERTEX_FLOATS / 2;
+}
+
+// Only the colours of the Sierpinski triangle, on one thread
+long long BuildSierpinskiColours(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_COLOUR_FLOATS * sizeof(float));
+    vector<float> colours(groups * SIERPINSKI_COLOUR_FLOATS);
+    assignColoursToLevelSierpinski(colours.data(), 0, 0, groups, level, false, 0);
+    return groups * SIERPINSKI_VERTEX_FLOATS / 2;
+}
+
+// Vertices and colours together, split between threads as when the program draws it
+long long BuildSierpinski(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP);
+    vector<float> data(groups * (SIERPINSKI_VERTEX_FLOATS + SIERPINSKI_COLOUR_FLOATS));
+    float *vertices = data.data();
+    float *colours = vertices + groups * SIERPINSKI_VERTEX_FLOATS;
+    GenerateSierpinski(vertices, colours, 0, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, level, false, 0);
+    return groups * SIERPINSKI_VERTEX_FLOATS / 2;
+}
+
+// The corners of every subdivision once each, with the indices drawing them
+long long BuildSierpinskiIndexed(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_INDEXED_BYTES_PER_GROUP);
+    long long count = groups * SIERPINSKI_INDEXED_VERTEX_FLOATS / 2;
+    int indexBytes = IndexBytes(count);
+    vector<float> data(groups * (SIERPINSKI_INDEXED_VERTEX_FLOATS + SIERPINSKI_INDEXED_COLOUR_FLOATS));
+    vector<char> indices(groups * SIERPINSKI_INDICES * indexBytes);
+    float *vertices = data.data();
+    float *colours = vertices + groups * SIERPINSKI_INDEXED_VERTEX_FLOATS;
+    GenerateSierpinski(vertices, colours, 0, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, level, true, 0);
+    SetupIndexBufferSierpinski(groups, indices.data(), indexBytes);
+    return count;
+}
+
+// Only the last iteration, as when the program steps up from the level below it
+long long BuildSierpinskiLevelStep(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP);
+    long long leaves = (2 * groups + 1) / 3;
+    vector<float> data(leaves * (SIERPINSKI_VERTEX_FLOATS + SIERPINSKI_COLOUR_FLOATS));
+    float *vertices = data.data();
+    float *colours = vertices + leaves * SIERPINSKI_VERTEX_FLOATS;
+    GenerateSierpinskiLeaves(vertices, colours, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, level, 0);
+    return leaves * SIERPINSKI_VERTEX_FLOATS / 2;
+}
+
+struct Generator
+{
+    const char *name;
+    long long (*build)(int level);
+};
+
+// Times builds of one generator until enough time has passed and prints its row
+void BenchmarkGenerator(const Generator &generator, int level, double minimumSeconds)
+{
+    const int MINIMUM_BUILDS = 3;
+
+    // the first build is only used to count allocations and memory
+    long long allocationsBefore = allocations;
+    long long heapBefore = heapBytes;
+    peakHeapBytes = heapBefore;
+    long long vertices = generator.build(level);
+    long long buildAllocations = allocations - allocationsBefore;
+    long long peakBytes = peakHeapBytes - heapBefore;
+
+    double best = 0.0;
+    double total = 0.0;
+    for (int builds = 0; builds < MINIMUM_BUILDS || total < minimumSeconds; builds++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        generator.build(level);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = builds == 0 ? elapsed : min(best, elapsed);
+        total += elapsed;
+    }
+
+    cout << generator.name << "," << level << "," << vertices << "," << best * 1.0e9 / vertices << ","
+         << buildAllocations << "," << peakBytes << endl;
+}
+
+// --------------------------------------------------------------------------
+// Chaos game: points per second for each number of threads, with a checksum
+// of the points showing that they do not depend on the number of threads
+
+// FNV-1a hash of the bytes of the floats
+unsigned long long HashFloats(const vector<float> &values)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char *bytes = (const unsigned char *)values.data();
+    for (size_t i = 0; i < values.size() * sizeof(float); i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+void BenchmarkChaosGame(long long maxPoints, double minimumSeconds)
+{
+    const int MINIMUM_BUILDS = 3;
+    int cores = max(1u, thread::hardware_concurrency());
+    cout << "points,threads,ns_per_point,points_per_second,checksum" << endl;
+    for (long long points = 1000000; points <= maxPoints; points *= 10)
+    {
+        vector<float> vertices(points * 2);
+        vector<float> colours(points * 3);
+        for (int threads = 1; threads <= cores; threads = threads < cores ? min(threads * 2, cores) : cores + 1)
+        {
+            double best = 0.0;
+            double total = 0.0;
+            for (int builds = 0; builds < MINIMUM_BUILDS || total < minimumSeconds; builds++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                GenerateChaosGame(vertices.data(), colours.data(), points, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, threads, 0);
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                best = builds == 0 ? elapsed : min(best, elapsed);
+                total += elapsed;
+            }
+            cout << points << "," << threads << "," << best * 1.0e9 / points << "," << (long long)(points / best)
+                 << "," << hex << (HashFloats(vertices) ^ HashFloats(colours)) << dec << endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int maxLevel = 10;
+    double minimumSeconds = 0.2;
+    bool chaosGame = false;
+    long long maxPoints = 100000000;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option.compare(0, 12, "--max-level=") == 0)
+        {
+            maxLevel = atoi(option.substr(12).c_str());
+        }
+        else if (option.compare(0, 14, "--min-seconds=") == 0)
+        {
+            minimumSeconds = atof(option.substr(14).c_str());
+        }
+        else if (option == "--chaos-game")
+        {
+            chaosGame = true;
+        }
+        else if (option.compare(0, 13, "--max-points=") == 0)
+        {
+            maxPoints = atoll(option.substr(13).c_str());
+        }
+        else
+        {
+            cout << "Unknown option " << option << endl;
+            cout << "Usage: benchmark [--max-level=<level>] [--min-seconds=<seconds per level>]"
+                 << " [--chaos-game [--max-points=<points>]]" << endl;
+            return -1;
+        }
+    }
+    if (chaosGame)
+    {
+        BenchmarkChaosGame(maxPoints, minimumSeconds);
+        return 0;
+    }
+
+    const Generator generators[] = {
+        { "square-and-diamond", BuildSquareAndDiamond },
+        { "square-and-diamond-indexed", BuildSquareAndDiamondIndexed },
+        { "spiral", BuildSpiral },
+        { "spiral-stacked-reference", BuildStackedSpiral },
+        { "spiral-adaptive", BuildAdaptiveSpiral },
+        { "sierpinski-vertices", BuildSierpinskiVertices },
+        { "sierpinski-colours", BuildSierpinskiColours },
+        { "sierpinski", BuildSierpinski },
+        { "sierpinski-indexed", BuildSierpinskiIndexed },
+        { "sierpinski-level-step", BuildSierpinskiLevelStep }
+    };
+    cout.setf(ios::fixed);
+    cout.precision(3);
+    cout << "generator,level,vertices,ns_per_vertex,allocations,peak_bytes" << endl;
+    for (size_t g = 0; g < sizeof(generators) / sizeof(generators[0]); g++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            if (SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP) < 0)
+            {
+                cerr << "Level " << level << " does not fit in the Sierpinski memory limit" << endl;
+                break;
+            }
+            BenchmarkGenerator(generators[g], level, minimumSeconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+// ==========================================================================
+// Compute program generating the Sierpinski triangle straight into its
+// vertex buffers
+//
+// Every invocation writes a run of consecutive subdivisions, in the depth
+// first order of renderTriangleLevel() in the main program. The first one is
+// found by decoding its index into the path through the subdivisions, as the
+// procedural vertex shader does, and the rest by stepping along that path.
+// The colours drift from one subdivision to the next with rounding that
+// depends on every step before, so the main program hands over the colours
+// of the first subdivision of every run and the drift of
+// driftSierpinskiColours() is replayed from there with the same single and
+// double precision operations
+// ==========================================================================
+#version 430
+
+layout(local_size_x = 64) in;
+
+// bound by ComputeSierpinskiTriangle() in the main program
+layout(std430, binding = 0) writeonly buffer Vertices
+{
+    vec2 positions[];           // twelve vertices per subdivision
+};
+layout(std430, binding = 1) writeonly buffer Colours
+{
+    float colours[];            // three floats per vertex
+};
+layout(std430, binding = 2) readonly buffer Checkpoints
+{
+    float checkpoints[];        // red, cyan and blue of the first subdivision of each run
+};
+
+uniform vec2 BaseTriangle[3];   // corners of the first iteration
+uniform int Level;              // number of iterations
+uniform int Groups;             // subdivisions of the whole triangle
+uniform int RunLength;          // subdivisions written by one invocation
+uniform float Factor;           // colour drift of one subdivision
+uniform double FactorSquared;
+
+// Corners of the triangle of a subdivision, and the number of subdivisions below it including itself
+struct Triangle
+{
+    vec2 p1, p2, p3;
+    int size;
+};
+
+// the three outer triangles of a subdivision, left bottom, right bottom and top, the top one listing
+// its corners from the top as pushSubTriangles() does
+Triangle Child(Triangle t, int child)
+{
+    precise vec2 m1 = (t.p1 + t.p2) / 2.0;
+    precise vec2 m2 = (t.p3 + t.p2) / 2.0;
+    precise vec2 m3 = (t.p3 + t.p1) / 2.0;
+    int size = (t.size - 1) / 3;
+    if (child == 0)
+    {
+        return Triangle(t.p1, m1, m3, size);
+    }
+    else if (child == 1)
+    {
+        return Triangle(m1, t.p2, m2, size);
+    }
+    return Triangle(t.p3, m2, m3, size);
+}
+
+void WriteColour(int vertex, vec3 colour)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        colours[3 * vertex + i] = colour[i];
+    }
+}
+
+void main()
+{
+    int run = int(gl_GlobalInvocationID.x);
+    int first = run * RunLength;
+    if (first >= Groups)
+    {
+        return;
+    }
+
+    // path from the base triangle down to the first subdivision of the run, keeping the triangles and
+    // the child taken at every iteration so the walk can carry on from there
+    Triangle path[32];
+    int taken[32];
+    int depth = 0;
+    path[0] = Triangle(BaseTriangle[0], BaseTriangle[1], BaseTriangle[2], Groups);
+    int index = first;
+    while (index > 0)
+    {
+        index -= 1;
+        int child = index / ((path[depth].size - 1) / 3);
+        index = index % ((path[depth].size - 1) / 3);
+        taken[depth] = child;
+        path[depth + 1] = Child(path[depth], child);
+        depth++;
+    }
+
+    precise float redR = checkpoints[9 * run];
+    precise float redG = checkpoints[9 * run + 1];
+    precise float redB = checkpoints[9 * run + 2];
+    precise float greenR = checkpoints[9 * run + 3];
+    precise float greenG = checkpoints[9 * run + 4];
+    precise float greenB = checkpoints[9 * run + 5];
+    precise float blueR = checkpoints[9 * run + 6];
+    precise float blueG = checkpoints[9 * run + 7];
+    precise float blueB = checkpoints[9 * run + 8];
+
+    int last = min(first + RunLength, Groups);
+    for (int group = first; group < last; group++)
+    {
+        // inverted triangle, then left bottom, right bottom and top triangles
+        Triangle t = path[depth];
+        precise vec2 m1 = (t.p1 + t.p2) / 2.0;
+        precise vec2 m2 = (t.p3 + t.p2) / 2.0;
+        precise vec2 m3 = (t.p3 + t.p1) / 2.0;
+        vec2 corners[12] = vec2[12](m1, m2, m3, t.p1, m1, m3, m1, t.p2, m2, m3, m2, t.p3);
+        vec3 triangleColours[4] = vec3[4](vec3(1.0), vec3(redR, redG, redB), vec3(greenR, greenG, greenB),
+                                          vec3(blueR, blueG, blueB));
+        for (int v = 0; v < 12; v++)
+        {
+            positions[12 * group + v] = corners[v];
+            WriteColour(12 * group + v, triangleColours[v / 3]);
+        }
+
+        // driftSierpinskiColours(), the mixed precision is part of the result
+        precise double alternate = (group % 2 == 0) ? 1.0LF : -1.0LF;
+        redR = float(double(redR) - FactorSquared);
+        redG = redG + Factor;
+        redB = redB + Factor / 2.0;
+        greenR = greenR + Factor;
+        greenG = float(double(greenR) - (double(Factor) + 0.1LF * alternate));
+        greenB = greenB + Factor / 2.0;
+        blueR = float(double(blueR) + (double(Factor) + 0.1LF * alternate));
+        blueG = blueG + Factor;
+        blueB = blueG - Factor / 4.0;
+
+        // next subdivision in depth first order: the first child while there are iterations left,
+        // otherwise the next sibling of the nearest triangle that still has one
+        if (t.size > 1)
+        {
+            taken[depth] = 0;
+            path[depth + 1] = Child(t, 0);
+            depth++;
+        }
+        else
+        {
+            while (depth > 0 && taken[depth - 1] == 2)
+            {
+                depth--;
+            }
+            if (depth > 0)
+            {
+                taken[depth - 1]++;
+                path[depth] = Child(path[depth - 1], taken[depth - 1]);
+            }
+        }
+    }
+}
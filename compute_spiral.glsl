@@ -0,0 +1,106 @@
+// ==========================================================================
+// Compute program generating the spiral straight into its vertex buffers
+//
+// Every invocation writes the segment of one sample and, unless the vertex
+// shader computes them, the colours of its two vertices. The sine and cosine
+// are the polynomials of SinCos4() and the ramp is SpiralColour() of the main
+// program, evaluated with the same single precision operations so that the
+// buffers match what EvaluateSpiral() and AssignSpiralColours() write
+// ==========================================================================
+#version 430
+
+layout(local_size_x = 64) in;
+
+// bound by ComputeSpiral() in the main program
+layout(std430, binding = 0) writeonly buffer Vertices
+{
+    vec4 segments[];            // inner and outer end of the segment of each sample
+};
+layout(std430, binding = 1) writeonly buffer Colours
+{
+    float colours[];            // three floats per vertex
+};
+
+uniform int Samples;
+uniform float RadiusStep;
+uniform float AngleStep;
+uniform float SegmentLength;
+uniform bool WriteColours;
+uniform int HiddenVertices;     // vertices of the copies the ramp used to run over first
+uniform float ColourStep;
+uniform int PhaseLength;
+
+// same reduction and polynomials as SinCos4(), precise keeps the compiler from fusing the operations
+void SinCos(float angle, out float sine, out float cosine)
+{
+    precise float quadrant = roundEven(angle * 0.63661977236758134);
+    int q = int(quadrant);
+    precise float x = angle - quadrant * 1.5703125;
+    x = x - quadrant * 4.8375129699707031e-4;
+    x = x - quadrant * 7.5497899548918821e-8;
+    precise float z = x * x;
+
+    precise float s = -1.9515295891e-4 * z + 8.3321608736e-3;
+    s = s * z + -1.6666654611e-1;
+    s = s * z * x + x;
+    precise float c = 2.443315711809948e-5 * z + -1.388731625493765e-3;
+    c = c * z + 4.166664568298827e-2;
+    c = c * z * z - 0.5 * z + 1.0;
+
+    // odd quadrants swap sine and cosine, the sign follows the quadrant
+    bool swap = (q & 1) == 1;
+    sine = swap ? c : s;
+    cosine = swap ? s : c;
+    sine = (q & 2) != 0 ? -sine : sine;
+    cosine = ((q + 1) & 2) != 0 ? -cosine : cosine;
+}
+
+// SpiralColour() of the main program
+vec3 RampColour(int i)
+{
+    int phase = i / PhaseLength;
+    int t = i % PhaseLength + 1;
+    int channel = phase % 3;
+    bool descending = phase % 6 < 3;
+    float before = descending ? 0.0 : 1.0;
+    float after = descending ? 1.0 : 0.0;
+    precise float current = t == PhaseLength ? before : (descending ? 1.0 - float(t) * ColourStep : float(t) * ColourStep);
+
+    vec3 colour;
+    for (int c = 0; c < 3; c++)
+    {
+        colour[c] = c < channel ? before : (c > channel ? after : current);
+    }
+    return colour;
+}
+
+void main()
+{
+    int k = int(gl_GlobalInvocationID.x);
+    if (k >= Samples)
+    {
+        return;
+    }
+
+    float sine, cosine;
+    precise float angle = float(k) * AngleStep;
+    SinCos(angle, sine, cosine);
+    precise float distance = RadiusStep * float(k);
+    precise float x1 = -distance * cosine;
+    precise float y1 = distance * sine;
+    precise float x2 = x1 - SegmentLength * cosine;
+    precise float y2 = y1 + SegmentLength * sine;
+    segments[k] = vec4(x1, y1, x2, y2);
+
+    if (WriteColours)
+    {
+        for (int v = 0; v < 2; v++)
+        {
+            vec3 colour = RampColour(2 * k + v + HiddenVertices);
+            int first = 3 * (2 * k + v);
+            colours[first] = colour.r;
+            colours[first + 1] = colour.g;
+            colours[first + 2] = colour.b;
+        }
+    }
+}
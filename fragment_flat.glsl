@@ -0,0 +1,18 @@
+// ==========================================================================
+// Fragment program for triangles coloured by their last vertex
+//
+// Same as fragment.glsl with the colour received without interpolation
+// ==========================================================================
+#version 410
+
+// colour of the provoking vertex received from vertex stage
+flat in vec3 Colour;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+void main(void)
+{
+    // write colour output without modification
+    FragmentColour = vec4(Colour, 0);
+}
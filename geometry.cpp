@@ -0,0 +1,1323 @@
+// ==========================================================================
+// Geometry generators for the square and diamond, the spirals and the
+// Sierpinski triangle, see geometry.h
+// ==========================================================================
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "geometry.h"
+
+using namespace std;
+
+long long sierpinskiMemoryLimit = 1024LL * 1024 * 1024;
+
+bool GeometryCancelled(const GeometryCancel *cancel)
+{
+    return cancel != 0 && cancel->latest->load(memory_order_relaxed) != cancel->id;
+}
+
+// --------------------------------------------------------------------------
+// Vertex format conversions
+
+// Converts a float to a half float, rounding to the nearest even value
+unsigned short FloatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    // positions never get this large, but keep them from wrapping around
+    if (exponent >= 31)
+    {
+        return sign | 0x7c00;
+    }
+
+    // too small for a normal half float, keep the bits that fit a denormal one
+    int shift = 13;
+    unsigned int half;
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+        half = mantissa >> shift;
+    }
+    else
+    {
+        half = (exponent << 10) | (mantissa >> shift);
+    }
+
+    // a carry out of the mantissa moves into the exponent, which is still the right result
+    unsigned int remainder = mantissa & ((1u << shift) - 1);
+    unsigned int halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1)))
+    {
+        half++;
+    }
+    return sign | half;
+}
+
+// Converts a coordinate in [-1, 1] to a 16 bit normalized integer
+short FloatToSnorm16(float value)
+{
+    value = min(max(value, -1.0f), 1.0f);
+    return (short)floorf(value * 32767.0f + 0.5f);
+}
+
+// Converts a colour component to a normalized byte, as the frame buffer would store it
+unsigned char NormalizedByte(float component)
+{
+    component = min(max(component, 0.0f), 1.0f);
+    return (unsigned char)(component * 255.0f + 0.5f);
+}
+// Packs count vertices (two floats each) with their colours (three floats each, or null) into four
+// bytes of position, as half floats or 16 bit normalized integers, and four bytes of colour per vertex.
+// The packed memory is only written, so it may be a mapped buffer
+void PackVertices(unsigned char *packed, const float *vertices, const float *colours, int count, bool halfFloats)
+{
+    int stride = colours != 0 ? 8 : 4;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned short *position = (unsigned short *)&packed[i * stride];
+        for (int c = 0; c < 2; c++)
+        {
+            position[c] = halfFloats ? FloatToHalf(vertices[2 * i + c]) : (unsigned short)FloatToSnorm16(vertices[2 * i + c]);
+        }
+        if (colours != 0)
+        {
+            unsigned char *colour = &packed[i * stride + 4];
+            colour[0] = NormalizedByte(colours[3 * i]);
+            colour[1] = NormalizedByte(colours[3 * i + 1]);
+            colour[2] = NormalizedByte(colours[3 * i + 2]);
+            colour[3] = 255;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Index buffers
+
+// Bytes of each index for a shape with the given number of vertices: 16 bit indices while they can
+// reach every vertex, 32 bit ones otherwise
+int IndexBytes(long long vertexCount)
+{
+    return vertexCount <= 65536 ? 2 : 4;
+}
+
+// Writes the pattern of indices once for each of count copies of a group of vertices, starting at
+// copy first, each copy moved along by the vertices of one group
+template <typename Index>
+void fillRepeatedIndices(Index *indices, const unsigned char *pattern, int patternLength, int groupVertices, long long first, long long count)
+{
+    for (long long copy = first; copy < first + count; copy++)
+    {
+        Index base = (Index)(copy * groupVertices);
+        for (int i = 0; i < patternLength; i++)
+        {
+            *indices++ = base + pattern[i];
+        }
+    }
+}
+
+// Writes the indices as 16 or 32 bit integers, see IndexBytes()
+void FillRepeatedIndices(void *indices, int indexBytes, const unsigned char *pattern, int patternLength, int groupVertices, long long first, long long count)
+{
+    if (indexBytes == 2)
+    {
+        fillRepeatedIndices((unsigned short *)indices, pattern, patternLength, groupVertices, first, count);
+    }
+    else
+    {
+        fillRepeatedIndices((unsigned int *)indices, pattern, patternLength, groupVertices, first, count);
+    }
+}
+
+// -------------------------------------------------------------------------
+// Square and diamond
+
+// Six vertices of the square and six of the diamond for every level
+int SquareAndDiamondVertexCount(int maxLevel)
+{
+    return maxLevel * 12;
+}
+
+// Four corners of the square and four of the diamond for every level, when they are drawn indexed
+int SquareAndDiamondIndexedVertexCount(int maxLevel)
+{
+    return maxLevel * 8;
+}
+
+// Corners of the square followed by those of the diamond, for a level of size one
+const float SQUARE_AND_DIAMOND_CORNERS[16] = {
+    -1.0f, -1.0f,  1.0f, 1.0f,  1.0f, -1.0f,  -1.0f, 1.0f,   // Square vertices
+     0.0f, -1.0f,  1.0f, 0.0f,  0.0f,  1.0f,  -1.0f, 0.0f    // Diamond vertices
+};
+
+// Two triangles of the square and two of the diamond made from the corners above
+const unsigned char SQUARE_AND_DIAMOND_INDICES[12] = { 0, 1, 2, 0, 1, 3, 4, 5, 6, 4, 7, 6 };
+
+// Fills the geometry data of the levels after firstLevel up to maxLevel, vertices must hold two floats
+// for each of the SquareAndDiamondVertexCount(maxLevel) - SquareAndDiamondVertexCount(firstLevel) vertices,
+// or of the SquareAndDiamondIndexedVertexCount() ones when indexed, where each corner is only written once.
+// Every level comes after the ones inside it, so the levels below firstLevel can be kept where they are
+void SetupVertexBufferSquareAndDiamond(int firstLevel, int maxLevel, float *vertices, bool indexed)
+{
+    // Base shape for all levels
+
+    // Number of vertices in current level
+    int counter = firstLevel;
+    while (counter < maxLevel)
+    {
+        float factor = (1/pow(2, counter));
+        for (int i = 0; i < (indexed ? 8 : 12); i++)
+        {
+            int corner = indexed ? i : SQUARE_AND_DIAMOND_INDICES[i];
+            *vertices++ = SQUARE_AND_DIAMOND_CORNERS[2 * corner] * factor;
+            *vertices++ = SQUARE_AND_DIAMOND_CORNERS[2 * corner + 1] * factor;
+        }
+
+       counter++;
+    }
+}
+
+// Fills the indices drawing the levels after firstLevel up to maxLevel from the vertices written by
+// SetupVertexBufferSquareAndDiamond() when indexed, as many as SquareAndDiamondVertexCount() gives for
+// the non indexed vertices. They refer to the vertices of the whole shape, starting from its first level
+void SetupIndexBufferSquareAndDiamond(int firstLevel, int maxLevel, void *indices, int indexBytes)
+{
+    FillRepeatedIndices(indices, indexBytes, SQUARE_AND_DIAMOND_INDICES, 12, 8, firstLevel, maxLevel - firstLevel);
+}
+
+// Generates the colour for the levels after firstLevel up to maxLevel of the square and diamond, colours
+// must hold three floats for each of their vertices. The colours of a level do not depend on maxLevel
+void SetupColourBufferSquareAndDiamond(int firstLevel, int maxLevel, float *colours, bool indexed)
+{
+    int corners = indexed ? 4 : 6;
+    float red = SQUARE_COLOUR[0];
+    float green = SQUARE_COLOUR[1];
+    float blue = SQUARE_COLOUR[2];
+    float diamondRed = DIAMOND_COLOUR[0];
+    float diamondGreen = DIAMOND_COLOUR[1];
+    float diamondBlue = DIAMOND_COLOUR[2];
+    int counter = 0;
+
+    float step = SQUARE_AND_DIAMOND_STEP;
+    while (counter < maxLevel)
+    {
+        // Base colour for level, darker for every level inside it
+        if (counter > 0)
+        {
+            red = red - step;
+            green = green - step;
+            blue = blue - step;
+            diamondRed = diamondRed - step;
+            diamondGreen = diamondGreen - step;
+            diamondBlue = diamondBlue - step;
+        }
+        if (counter >= firstLevel)
+        {
+            for (int i = 0; i < corners; i++)
+            {
+                *colours++ = red;
+                *colours++ = green;
+                *colours++ = blue;
+            }
+            for (int j = 0; j < corners; j++)
+            {
+                *colours++ = diamondRed;
+                *colours++ = diamondGreen;
+                *colours++ = diamondBlue;
+            }
+        }
+        counter++;
+    }
+}
+// -------------------------------------------------------------------------
+// Spiral
+
+// Number of samples along a spiral with the given revolutions, one line segment is drawn per sample
+int SpiralSampleCount(int level)
+{
+    // 400 segments per revolution, sampled every quarter segment
+    return 400 * level * 4;
+}
+
+// Writes the two vertices of the segments for samples first to first + count - 1. Sample k lies at
+// angle k * angleStep and distance k * radiusStep from the centre, each segment points outwards
+// from there. The calculation for the x and y coordinates was based on: http://stackoverflow.com/a/18893438
+void SpiralSegmentsScalar(float *vertices, int first, int count, float radiusStep, float angleStep)
+{
+    for (int k = first; k < first + count; k++)
+    {
+        float theta = k * angleStep;
+        float cosine = cosf(theta);
+        float sine = sinf(theta);
+        float distance = radiusStep * k;
+        float x1 = -distance * cosine;
+        float y1 = distance * sine;
+        *vertices++ = x1;
+        *vertices++ = y1;
+        *vertices++ = x1 - SPIRAL_SEGMENT_LENGTH * cosine;
+        *vertices++ = y1 + SPIRAL_SEGMENT_LENGTH * sine;
+    }
+}
+
+#if defined(__SSE2__)
+// Sine and cosine of four angles: the angle is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2,
+// which is subtracted in three parts to keep the precision, and both are evaluated with minimax polynomials
+void SinCos4(__m128 angle, __m128 *sine, __m128 *cosine)
+{
+    __m128 quadrant = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(0.63661977236758134f))));
+    __m128i q = _mm_cvtps_epi32(quadrant);
+    __m128 x = _mm_sub_ps(angle, _mm_mul_ps(quadrant, _mm_set1_ps(1.5703125f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(4.8375129699707031e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(7.5497899548918821e-8f)));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+    __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+    // odd quadrants swap sine and cosine, the sign follows the quadrant
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+    __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    *sine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sineSign);
+    *cosine = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cosineSign);
+}
+
+// Same as SpiralSegmentsScalar() for four samples at a time
+void SpiralSegmentsSSE(float *vertices, int first, int count, float radiusStep, float angleStep)
+{
+    __m128 k = _mm_add_ps(_mm_set1_ps((float)first), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    for (int i = 0; i < count; i += 4)
+    {
+        __m128 sine, cosine;
+        SinCos4(_mm_mul_ps(k, _mm_set1_ps(angleStep)), &sine, &cosine);
+        __m128 distance = _mm_mul_ps(_mm_set1_ps(radiusStep), k);
+        __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), distance), cosine);
+        __m128 y1 = _mm_mul_ps(distance, sine);
+        __m128 x2 = _mm_sub_ps(x1, _mm_mul_ps(_mm_set1_ps(SPIRAL_SEGMENT_LENGTH), cosine));
+        __m128 y2 = _mm_add_ps(y1, _mm_mul_ps(_mm_set1_ps(SPIRAL_SEGMENT_LENGTH), sine));
+
+        // interleave into x1, y1, x2, y2 for each sample
+        __m128 inner = _mm_unpacklo_ps(x1, y1);
+        __m128 outer = _mm_unpacklo_ps(x2, y2);
+        _mm_storeu_ps(vertices, _mm_movelh_ps(inner, outer));
+        _mm_storeu_ps(vertices + 4, _mm_movehl_ps(outer, inner));
+        inner = _mm_unpackhi_ps(x1, y1);
+        outer = _mm_unpackhi_ps(x2, y2);
+        _mm_storeu_ps(vertices + 8, _mm_movelh_ps(inner, outer));
+        _mm_storeu_ps(vertices + 12, _mm_movehl_ps(outer, inner));
+
+        vertices += 16;
+        k = _mm_add_ps(k, _mm_set1_ps(4.0f));
+    }
+}
+#endif
+
+#if defined(__AVX__)
+// Same as SinCos4() for eight angles
+void SinCos8(__m256 angle, __m256 *sine, __m256 *cosine)
+{
+    __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(0.63661977236758134f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 x = _mm256_sub_ps(angle, _mm256_mul_ps(quadrant, _mm256_set1_ps(1.5703125f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(4.8375129699707031e-4f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(quadrant, _mm256_set1_ps(7.5497899548918821e-8f)));
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-1.9515295891e-4f), z), _mm256_set1_ps(8.3321608736e-3f));
+    s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(-1.6666654611e-1f));
+    s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, z), x), x);
+    __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.443315711809948e-5f), z), _mm256_set1_ps(-1.388731625493765e-3f));
+    c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(4.166664568298827e-2f));
+    c = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(c, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+
+    // odd quadrants swap sine and cosine, the sign follows the quadrant. AVX has no 256 bit integer
+    // operations, so the quadrant bits are taken from its remainders as floats
+    __m256 half = _mm256_mul_ps(quadrant, _mm256_set1_ps(0.5f));
+    __m256 odd = _mm256_cmp_ps(_mm256_floor_ps(half), half, _CMP_NEQ_OQ);
+    __m256 quarter = _mm256_mul_ps(quadrant, _mm256_set1_ps(0.25f));
+    __m256 fraction = _mm256_sub_ps(quarter, _mm256_floor_ps(quarter));      // 0, 1/4, 1/2 or 3/4
+    __m256 negative = _mm256_set1_ps(-0.0f);
+    __m256 sineSign = _mm256_and_ps(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.375f), _CMP_GT_OQ), negative);
+    __m256 cosineSign = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.125f), _CMP_GT_OQ),
+                                                    _mm256_cmp_ps(fraction, _mm256_set1_ps(0.625f), _CMP_LT_OQ)), negative);
+    *sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, odd), sineSign);
+    *cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, odd), cosineSign);
+}
+
+// Same as SpiralSegmentsScalar() for eight samples at a time
+void SpiralSegmentsAVX(float *vertices, int first, int count, float radiusStep, float angleStep)
+{
+    __m256 k = _mm256_add_ps(_mm256_set1_ps((float)first), _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f));
+    for (int i = 0; i < count; i += 8)
+    {
+        __m256 sine, cosine;
+        SinCos8(_mm256_mul_ps(k, _mm256_set1_ps(angleStep)), &sine, &cosine);
+        __m256 distance = _mm256_mul_ps(_mm256_set1_ps(radiusStep), k);
+        __m256 x1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), distance), cosine);
+        __m256 y1 = _mm256_mul_ps(distance, sine);
+        __m256 x2 = _mm256_sub_ps(x1, _mm256_mul_ps(_mm256_set1_ps(SPIRAL_SEGMENT_LENGTH), cosine));
+        __m256 y2 = _mm256_add_ps(y1, _mm256_mul_ps(_mm256_set1_ps(SPIRAL_SEGMENT_LENGTH), sine));
+
+        // interleave into x1, y1, x2, y2 for each sample, the unpacks work within each half
+        __m256d innerLow = _mm256_castps_pd(_mm256_unpacklo_ps(x1, y1));     // samples 0, 1 | 4, 5
+        __m256d innerHigh = _mm256_castps_pd(_mm256_unpackhi_ps(x1, y1));    // samples 2, 3 | 6, 7
+        __m256d outerLow = _mm256_castps_pd(_mm256_unpacklo_ps(x2, y2));
+        __m256d outerHigh = _mm256_castps_pd(_mm256_unpackhi_ps(x2, y2));
+        __m256 s04 = _mm256_castpd_ps(_mm256_unpacklo_pd(innerLow, outerLow));
+        __m256 s15 = _mm256_castpd_ps(_mm256_unpackhi_pd(innerLow, outerLow));
+        __m256 s26 = _mm256_castpd_ps(_mm256_unpacklo_pd(innerHigh, outerHigh));
+        __m256 s37 = _mm256_castpd_ps(_mm256_unpackhi_pd(innerHigh, outerHigh));
+        _mm256_storeu_ps(vertices, _mm256_permute2f128_ps(s04, s15, 0x20));
+        _mm256_storeu_ps(vertices + 8, _mm256_permute2f128_ps(s26, s37, 0x20));
+        _mm256_storeu_ps(vertices + 16, _mm256_permute2f128_ps(s04, s15, 0x31));
+        _mm256_storeu_ps(vertices + 24, _mm256_permute2f128_ps(s26, s37, 0x31));
+
+        vertices += 32;
+        k = _mm256_add_ps(k, _mm256_set1_ps(8.0f));
+    }
+}
+#endif
+
+// Distance from the centre and angle gained from one sample to the next along a spiral with the
+// given revolutions, which ends at a radius of one
+void SpiralSteps(int level, float *radiusStep, float *angleStep)
+{
+    float numberSegments = 400.0 * level;
+    float radius = 1.0f;
+    *radiusStep = (radius / numberSegments) * 0.25f;
+    *angleStep = ((level - 0.5) * 2.0 * PI * 0.25) / numberSegments;
+}
+
+// Fills the preallocated vertices (four floats per sample) of a spiral with the given revolutions,
+// using the widest vector instructions the program was compiled for
+void EvaluateSpiral(float *vertices, int level)
+{
+    int samples = SpiralSampleCount(level);
+    float radiusStep, angleStep;
+    SpiralSteps(level, &radiusStep, &angleStep);
+
+    int vectorised = 0;
+#if defined(__AVX__)
+    vectorised = samples / 8 * 8;
+    SpiralSegmentsAVX(vertices, 0, vectorised, radiusStep, angleStep);
+#elif defined(__SSE2__)
+    vectorised = samples / 4 * 4;
+    SpiralSegmentsSSE(vertices, 0, vectorised, radiusStep, angleStep);
+#endif
+    SpiralSegmentsScalar(vertices + vectorised * 4, vectorised, samples - vectorised, radiusStep, angleStep);
+}
+
+// Picks the samples of a spiral with the given revolutions so that the outer ends of neighbouring
+// segments lie targetPixels apart on a screen of pixelsPerUnit, instead of the fixed step of
+// EvaluateSpiral(). Where the curve bends sharply the step also keeps the arc it skips within a quarter
+// of targetPixels of the chord. Samples are stored as fractional indices of the fixed step samples, the
+// first and the last one are always kept
+void AdaptiveSpiralSamples(int level, float pixelsPerUnit, float targetPixels, vector<float> *samples)
+{
+    float radiusStep, angleStep;
+    SpiralSteps(level, &radiusStep, &angleStep);
+    int last = SpiralSampleCount(level) - 1;
+
+    // the outer ends follow R(angle) = growth * angle + SPIRAL_SEGMENT_LENGTH, in pixels
+    double growth = radiusStep / angleStep * pixelsPerUnit;
+    double tolerance = targetPixels * 0.25;
+    samples->clear();
+    for (double k = 0.0; k < last; )
+    {
+        samples->push_back((float)k);
+        double outer = (radiusStep * k + SPIRAL_SEGMENT_LENGTH) * pixelsPerUnit;
+        double speed = sqrt(outer * outer + growth * growth);
+        // curvature of a polar curve with a constant dR/dangle, the chord of an arc of length s
+        // strays s * s * curvature / 8 from it
+        double curvature = (outer * outer + 2.0 * growth * growth) / (speed * speed * speed);
+        double length = min((double)targetPixels, sqrt(8.0 * tolerance / curvature));
+        k += max(length / speed / angleStep, 1.0e-3);
+    }
+    samples->push_back((float)last);
+}
+
+// Fills the preallocated vertices (four floats per sample) of a spiral at the given samples
+void EvaluateSpiralSamples(float *vertices, const float *samples, int count, int level)
+{
+    float radiusStep, angleStep;
+    SpiralSteps(level, &radiusStep, &angleStep);
+    for (int i = 0; i < count; i++)
+    {
+        float theta = samples[i] * angleStep;
+        float cosine = cosf(theta);
+        float sine = sinf(theta);
+        float distance = radiusStep * samples[i];
+        float x1 = -distance * cosine;
+        float y1 = distance * sine;
+        *vertices++ = x1;
+        *vertices++ = y1;
+        *vertices++ = x1 - SPIRAL_SEGMENT_LENGTH * cosine;
+        *vertices++ = y1 + SPIRAL_SEGMENT_LENGTH * sine;
+    }
+}
+
+// Colour of spiral vertex i. The ramp takes red, green and then blue from one down to zero, and then
+// back up in the same order, each change lasting phaseLength vertices. It is the closed form of the
+// original colour loop, which added step to one channel per vertex and moved on once it clamped
+void SpiralColour(float *colour, int i, float step, int phaseLength)
+{
+    int phase = i / phaseLength;
+    int t = i % phaseLength + 1;
+    int channel = phase % 3;
+    bool descending = phase % 6 < 3;
+    for (int c = 0; c < 3; c++)
+    {
+        if (c < channel)
+        {
+            colour[c] = descending ? 0.0f : 1.0f;
+        }
+        else if (c > channel)
+        {
+            colour[c] = descending ? 1.0f : 0.0f;
+        }
+        else if (t == phaseLength)
+        {
+            colour[c] = descending ? 0.0f : 1.0f;
+        }
+        else
+        {
+            colour[c] = descending ? 1.0f - t * step : t * step;
+        }
+    }
+}
+
+// Colours for the spiral vertices first to first + count - 1, run by a worker thread
+void FillSpiralColours(float *colours, int first, int count, int level, const GeometryCancel *cancel)
+{
+    // The spiral used to be generated once per level on top of itself, with the ramp running over all
+    // the copies and 3.5 channel changes per copy. Only the last copy was visible, so the ramp starts
+    // where that copy started
+    int vertices = SpiralSampleCount(level) * 2;
+    int hiddenVertices = (level - 1) * vertices;
+    float step = 3.5f / vertices;
+    int phaseLength = 2 * vertices / 7 + 1;
+    for (int i = first; i < first + count; i++)
+    {
+        if ((i - first) % GEOMETRY_CANCEL_INTERVAL == 0 && GeometryCancelled(cancel))
+        {
+            return;
+        }
+        SpiralColour(colours + 3 * i, i + hiddenVertices, step, phaseLength);
+    }
+}
+
+// Fills the preallocated colours (three floats per vertex) of a spiral at the given samples, each
+// segment takes the colours of the nearest fixed step sample so the ramp looks the same
+void AssignSpiralSampleColours(float *colours, const float *samples, int count, int level)
+{
+    int vertices = SpiralSampleCount(level) * 2;
+    int hiddenVertices = (level - 1) * vertices;
+    float step = 3.5f / vertices;
+    int phaseLength = 2 * vertices / 7 + 1;
+    for (int i = 0; i < count; i++)
+    {
+        int vertex = 2 * (int)(samples[i] + 0.5f);
+        SpiralColour(colours + 6 * i, vertex + hiddenVertices, step, phaseLength);
+        SpiralColour(colours + 6 * i + 3, vertex + 1 + hiddenVertices, step, phaseLength);
+    }
+}
+
+// Fills the preallocated colours (three floats per vertex) of a spiral with the given revolutions.
+// Every colour only depends on its vertex index, so large spirals are split between threads
+void AssignSpiralColours(float *colours, int level, const GeometryCancel *cancel)
+{
+    int vertices = SpiralSampleCount(level) * 2;
+    int threads = vertices < SPIRAL_PARALLEL_VERTICES ? 1 : max(1u, thread::hardware_concurrency());
+    int chunk = (vertices + threads - 1) / threads;
+    vector<thread> workers;
+    for (int first = chunk; first < vertices; first += chunk)
+    {
+        workers.push_back(thread(FillSpiralColours, colours, first, min(chunk, vertices - first), level, cancel));
+    }
+    FillSpiralColours(colours, 0, min(chunk, vertices), level, cancel);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+// The spiral as the program first generated it, kept as the reference EvaluateSpiral() and
+// AssignSpiralColours() are checked and timed against. The whole spiral is stacked once per revolution,
+// each copy drawn over the one before, and the colour loop runs one vertex past the end. Only the last
+// copy is visible, it starts at vertex (level - 1) * SpiralSampleCount(level) * 2
+void StackedSpiralReference(int level, vector<float> *vertices, vector<float> *colours)
+{
+    int verticesCounter = 0;
+    vertices->clear();
+    colours->clear();
+
+    float radius = 1.0f;
+    for (int i = 0; i < level; i++)
+    {
+        float numberSegments = 400.0 * level;
+        for (float j = 0.0f; j < numberSegments; j += 0.25f)
+        {
+            float theta = ((level - 0.5) * 2.0 * PI * j) / numberSegments;
+            float x1 = -(radius / numberSegments) * j * cosf(theta);
+            float y1 = (radius / numberSegments) * j * sinf(theta);
+            float x2 = x1 - 0.01f * cosf(theta);
+            float y2 = y1 + 0.01f * sinf(theta);
+            vertices->push_back(x1);
+            vertices->push_back(y1);
+            vertices->push_back(x2);
+            vertices->push_back(y2);
+            verticesCounter += 2;
+        }
+    }
+
+    float red = 1.0f;
+    float green = 1.0f;
+    float blue = 1.0f;
+    int modifyColour = 1;
+    float direction = -1.0f;
+    float step = (3.5f * level) / verticesCounter;
+    for (int i = 0; i <= verticesCounter; i++)
+    {
+        if (modifyColour == 1)
+        {
+            red = red + direction * step;
+            if (red > 1.0f || red < 0.0f)
+            {
+                modifyColour = 2;
+                red = red > 1.0f ? 1.0f : 0.0f;
+            }
+        }
+        else if (modifyColour == 2)
+        {
+            green = green + direction * step;
+            if (green > 1.0f || green < 0.0f)
+            {
+                modifyColour = 3;
+                green = green > 1.0f ? 1.0f : 0.0f;
+            }
+        }
+        else
+        {
+            blue = blue + direction * step;
+            if (blue > 1.0f || blue < 0.0f)
+            {
+                modifyColour = 1;
+                blue = blue > 1.0f ? 1.0f : 0.0f;
+                direction = direction * -1.0f;
+            }
+        }
+        colours->push_back(red);
+        colours->push_back(green);
+        colours->push_back(blue);
+    }
+}
+// ----------------------------------------------------------------------------------
+// Sierpinski triangle
+
+// Number of subdivisions (groups of four triangles) the recursion performs down to maxLevel, or -1
+// if storing bytesPerGroup for each does not fit in the memory limit or they have too many vertices to draw
+long long SierpinskiGroupCount(int maxLevel, long long bytesPerGroup)
+{
+    long long power = 1;
+    for (int i = 0; i < maxLevel; i++)
+    {
+        power *= 3;
+        long long groups = (power - 1) / 2;
+        if (groups * bytesPerGroup > sierpinskiMemoryLimit || groups * SIERPINSKI_VERTEX_FLOATS / 2 > INT_MAX)
+        {
+            return -1;
+        }
+    }
+    return (power - 1) / 2;
+}
+
+// Corners of the inverted white triangle of a subdivision, the midpoints of the sides of the triangle
+SierpinskiTriangle invertedTriangle(const SierpinskiTriangle &t)
+{
+    return SierpinskiTriangle((t.x1+t.x2)/2.0f, (t.y2+t.y1)/2.0f,
+                              (t.x3+t.x2)/2.0f, (t.y3+t.y2)/2.0f,
+                              (t.x3+t.x1)/2.0f, (t.y3+t.y1)/2.0f, t.level);
+}
+
+// Writes the four triangles of one subdivision
+float *fillSubdivisionVertices(float *vertices, const SierpinskiTriangle &t, const SierpinskiTriangle &inv)
+{
+    // Inverted white triangle
+    *vertices++ = inv.x1; *vertices++ = inv.y1;
+    *vertices++ = inv.x2; *vertices++ = inv.y2;
+    *vertices++ = inv.x3; *vertices++ = inv.y3;
+
+    // First triangle left bottom
+    *vertices++ = t.x1;   *vertices++ = t.y1;
+    *vertices++ = inv.x1; *vertices++ = inv.y1;
+    *vertices++ = inv.x3; *vertices++ = inv.y3;
+
+    // Second triangle right bottom
+    *vertices++ = inv.x1; *vertices++ = inv.y1;
+    *vertices++ = t.x2;   *vertices++ = t.y2;
+    *vertices++ = inv.x2; *vertices++ = inv.y2;
+
+    // Third triangle on top
+    *vertices++ = inv.x3; *vertices++ = inv.y3;
+    *vertices++ = inv.x2; *vertices++ = inv.y2;
+    *vertices++ = t.x3;   *vertices++ = t.y3;
+    return vertices;
+}
+
+// Writes the six corners of one subdivision for drawing it indexed: the midpoints of its sides, which
+// are the corners of the inverted triangle, followed by the corners of the triangle
+float *fillSubdivisionCorners(float *vertices, const SierpinskiTriangle &t, const SierpinskiTriangle &inv)
+{
+    *vertices++ = inv.x1; *vertices++ = inv.y1;
+    *vertices++ = inv.x2; *vertices++ = inv.y2;
+    *vertices++ = inv.x3; *vertices++ = inv.y3;
+    *vertices++ = t.x1;   *vertices++ = t.y1;
+    *vertices++ = t.x2;   *vertices++ = t.y2;
+    *vertices++ = t.x3;   *vertices++ = t.y3;
+    return vertices;
+}
+
+// The four triangles of a subdivision made from the corners above, in the order of
+// fillSubdivisionVertices(). Each one lists the corner holding its colour last, as the provoking
+// vertex of flat shading, so the corners can be shared between triangles of different colours
+const unsigned char SIERPINSKI_SUBDIVISION_INDICES[SIERPINSKI_INDICES] = {
+    1, 2, 0,    // Inverted white triangle
+    0, 2, 3,    // First triangle left bottom
+    1, 0, 4,    // Second triangle right bottom
+    2, 1, 5     // Third triangle on top
+};
+
+// Pushes the three outer triangles of a subdivision to be subdivided next, in reverse so the left
+// bottom triangle is subdivided first
+void pushSubTriangles(vector<SierpinskiTriangle> &pending, const SierpinskiTriangle &t, const SierpinskiTriangle &inv)
+{
+    int nextLevel = t.level + 1;
+    pending.push_back(SierpinskiTriangle(t.x3, t.y3, inv.x2, inv.y2, inv.x3, inv.y3, nextLevel));
+    pending.push_back(SierpinskiTriangle(inv.x1, inv.y1, t.x2, t.y2, inv.x2, inv.y2, nextLevel));
+    pending.push_back(SierpinskiTriangle(t.x1, t.y1, inv.x1, inv.y1, inv.x3, inv.y3, nextLevel));
+}
+
+// Calculations of the coordinates of the triangles within an iteration and of every iteration
+// below it, written in the same order as a depth first recursion. Either output may be null,
+// instances receive the first corner and scale of each subdivided triangle instead of its vertices.
+// When indexed only the six corners of each subdivision are written
+void renderTriangleLevel(float *vertices, SierpinskiInstance *instances, float x1, float y1, float x2, float y2, float x3, float y3, int level, int maxLevel, bool indexed, const GeometryCancel *cancel)
+{
+    // Triangles still to be subdivided, the next one to visit is on top
+    vector<SierpinskiTriangle> pending;
+    pending.reserve(2 * (maxLevel - level) + 1);
+    pending.push_back(SierpinskiTriangle(x1, y1, x2, y2, x3, y3, level));
+
+    while (!pending.empty())
+    {
+        SierpinskiTriangle t = pending.back();
+        pending.pop_back();
+        if ((t.level == level || t.level + GEOMETRY_CANCEL_LEVELS == maxLevel) && GeometryCancelled(cancel))
+        {
+            return;
+        }
+        SierpinskiTriangle inv = invertedTriangle(t);
+
+        if (vertices != 0)
+        {
+            vertices = indexed ? fillSubdivisionCorners(vertices, t, inv) : fillSubdivisionVertices(vertices, t, inv);
+        }
+        if (instances != 0)
+        {
+            // Each iteration halves the size of the triangles. The top sub-triangle lists its corners
+            // starting from the top, which flips the order of its sub-triangles and is stored in the sign
+            bool flipped = t.y1 > t.y3;
+            instances->offsetX = flipped ? t.x3 : t.x1;
+            instances->offsetY = flipped ? t.y3 : t.y1;
+            instances->scale = flipped ? -ldexpf(1.0f, 1 - t.level) : ldexpf(1.0f, 1 - t.level);
+            instances++;
+        }
+
+        if (t.level < maxLevel)
+        {
+            pushSubTriangles(pending, t, inv);
+        }
+    }
+}
+
+// Writes a colour as normalized bytes for an instance attribute
+void fillInstanceColour(unsigned char *colour, float red, float green, float blue)
+{
+    colour[0] = NormalizedByte(red);
+    colour[1] = NormalizedByte(green);
+    colour[2] = NormalizedByte(blue);
+    colour[3] = 255;
+}
+
+// Writes the three vertex colours of one triangle
+float *fillOneTriangleColour(float *colours, float red, float green, float blue)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        *colours++ = red;
+        *colours++ = green;
+        *colours++ = blue;
+    }
+    return colours;
+}
+
+// Colours of the outer triangles of a subdivision. Each subdivision, in depth first order, takes the
+// colours of the previous one drifted by a step that depends on the number of iterations
+struct SierpinskiColours
+{
+    float factor;
+    double factorSquared;
+    // Red triangle
+    float redR, redG, redB;
+    // Cyan triangle
+    float greenR, greenG, greenB;
+    // Blue triangle
+    float blueR, blueG, blueB;
+
+    SierpinskiColours(int maxLevel)
+        : factor(1.0f / (maxLevel * 72.0f)), factorSquared(pow(factor, 2)),
+          redR(0.9f), redG(0.0f), redB(0.3f),
+          greenR(0.0f), greenG(0.7f), greenB(0.5f),
+          blueR(0.5f), blueG(0.0f), blueB(1.0f)
+    {}
+};
+
+// Moves the colours from subdivision i to the next one
+void driftSierpinskiColours(SierpinskiColours *c, long long i)
+{
+    double alternate = (i % 2 == 0) ? 1.0 : -1.0;
+
+    // Modify red triangles
+    c->redR = c->redR - c->factorSquared;
+    c->redG = c->redG + c->factor;
+    c->redB = c->redB + (c->factor/2.0f);
+
+    // Modify Cyan triangles
+    c->greenR = c->greenR + c->factor;
+    c->greenG = c->greenR - (c->factor + 0.1 * alternate);
+    c->greenB = c->greenB + (c->factor/2.0f);
+
+    // Modify blue triangles
+    c->blueR = c->blueR + (c->factor + 0.1 * alternate);
+    c->blueG = c->blueG + c->factor;
+    c->blueB = c->blueG - c->factor/4.0f;
+}
+
+// Writes the vertex colours of the four triangles of one subdivision
+float *fillSubdivisionColours(float *colours, const SierpinskiColours &c)
+{
+    colours = fillOneTriangleColour(colours, 1.0f, 1.0f, 1.0f); // White triangle
+    colours = fillOneTriangleColour(colours, c.redR, c.redG, c.redB); // Red triangle
+    colours = fillOneTriangleColour(colours, c.greenR, c.greenG, c.greenB); // Cyan triangle
+    colours = fillOneTriangleColour(colours, c.blueR, c.blueG, c.blueB); // Blue triangle
+    return colours;
+}
+
+// Writes the colours of the six corners of one subdivision written by fillSubdivisionCorners(). Only
+// the corner each triangle lists last gives it its colour, the other midpoints are white as well
+float *fillSubdivisionCornerColours(float *colours, const SierpinskiColours &c)
+{
+    for (int i = 0; i < 9; i++)
+    {
+        *colours++ = 1.0f; // White triangle
+    }
+    *colours++ = c.redR;   *colours++ = c.redG;   *colours++ = c.redB;
+    *colours++ = c.greenR; *colours++ = c.greenG; *colours++ = c.greenB;
+    *colours++ = c.blueR;  *colours++ = c.blueG;  *colours++ = c.blueB;
+    return colours;
+}
+
+// Colours for the subdivisions firstGroup to firstGroup + groupCount of the whole triangle, starting
+// with c, the colours of subdivision firstGroup. Either output may be null, when indexed the colours are
+// those of the six corners of each subdivision
+void assignColoursFrom(float *colours, SierpinskiInstance *instances, SierpinskiColours c, long long firstGroup, long long groupCount, bool indexed, const GeometryCancel *cancel)
+{
+    for (long long i = firstGroup; i < firstGroup + groupCount; i++)
+    {
+        if ((i - firstGroup) % GEOMETRY_CANCEL_INTERVAL == 0 && GeometryCancelled(cancel))
+        {
+            return;
+        }
+        if (colours != 0)
+        {
+            colours = indexed ? fillSubdivisionCornerColours(colours, c) : fillSubdivisionColours(colours, c);
+        }
+        if (instances != 0)
+        {
+            // The white triangle is the same for every instance
+            fillInstanceColour(instances->red, c.redR, c.redG, c.redB);
+            fillInstanceColour(instances->cyan, c.greenR, c.greenG, c.greenB);
+            fillInstanceColour(instances->blue, c.blueR, c.blueG, c.blueB);
+            instances++;
+        }
+        driftSierpinskiColours(&c, i);
+    }
+}
+
+// Colours for the subdivisions firstGroup to firstGroup + groupCount of the whole triangle. The colours
+// of each subdivision drift from the previous one, so the drift is replayed from the base triangle
+void assignColoursToLevelSierpinski(float *colours, SierpinskiInstance *instances, long long firstGroup, long long groupCount, int maxLevel, bool indexed, const GeometryCancel *cancel)
+{
+    SierpinskiColours c(maxLevel);
+    for (long long i = 0; i < firstGroup; i++)
+    {
+        if (i % GEOMETRY_CANCEL_INTERVAL == 0 && GeometryCancelled(cancel))
+        {
+            return;
+        }
+        driftSierpinskiColours(&c, i);
+    }
+    assignColoursFrom(colours, instances, c, firstGroup, groupCount, indexed, cancel);
+}
+
+// Colours of the red, cyan and blue triangles of every interval-th subdivision, starting with the first,
+// SIERPINSKI_CHECKPOINT_FLOATS each. The drift from one of them to the next can then be replayed by
+// someone else, such as a compute shader, without replaying everything before it
+void SierpinskiColourCheckpoints(float *checkpoints, long long groups, int maxLevel, int interval)
+{
+    SierpinskiColours c(maxLevel);
+    for (long long i = 0; i < groups; i++)
+    {
+        if (i % interval == 0)
+        {
+            *checkpoints++ = c.redR;   *checkpoints++ = c.redG;   *checkpoints++ = c.redB;
+            *checkpoints++ = c.greenR; *checkpoints++ = c.greenG; *checkpoints++ = c.greenB;
+            *checkpoints++ = c.blueR;  *checkpoints++ = c.blueG;  *checkpoints++ = c.blueB;
+        }
+        driftSierpinskiColours(&c, i);
+    }
+}
+
+// Drift of the colours from one subdivision to the next in a triangle of maxLevel iterations, see
+// driftSierpinskiColours()
+void SierpinskiColourFactors(int maxLevel, float *factor, double *factorSquared)
+{
+    SierpinskiColours c(maxLevel);
+    *factor = c.factor;
+    *factorSquared = c.factorSquared;
+}
+
+// Generates the vertices and colours of the subtree below one triangle, run by a worker thread. Its
+// colours start with c, those of its first subdivision
+void GenerateSierpinskiSubtree(float *vertices, float *colours, SierpinskiInstance *instances, SierpinskiTriangle t, SierpinskiColours c, long long firstGroup, long long groupCount, int maxLevel, bool indexed, const GeometryCancel *cancel)
+{
+    renderTriangleLevel(vertices, instances, t.x1, t.y1, t.x2, t.y2, t.x3, t.y3, t.level, maxLevel, indexed, cancel);
+    assignColoursFrom(colours, instances, c, firstGroup, groupCount, indexed, cancel);
+}
+
+// Fills the preallocated vertex and colour arrays, or the instance array, for all iterations up to maxLevel.
+// When indexed the arrays hold the corners of each subdivision, to be drawn with SetupIndexBufferSierpinski().
+// The subtrees of the three sub-triangles of the base triangle are independent and are generated on their own threads
+void GenerateSierpinski(float *vertices, float *colours, SierpinskiInstance *instances, float x1, float y1, float x2, float y2, float x3, float y3, int maxLevel, bool indexed, const GeometryCancel *cancel)
+{
+    long long groups = SierpinskiGroupCount(maxLevel, 0);
+    if (groups < SIERPINSKI_PARALLEL_GROUPS)
+    {
+        renderTriangleLevel(vertices, instances, x1, y1, x2, y2, x3, y3, 1, maxLevel, indexed, cancel);
+        assignColoursToLevelSierpinski(colours, instances, 0, groups, maxLevel, indexed, cancel);
+        return;
+    }
+
+    // First iteration on this thread, it comes first in the arrays
+    renderTriangleLevel(vertices, instances, x1, y1, x2, y2, x3, y3, 1, 1, indexed, cancel);
+    assignColoursToLevelSierpinski(colours, instances, 0, 1, maxLevel, indexed, cancel);
+
+    float x1Inv = (x1+x2)/2.0f;
+    float y1Inv = (y2+y1)/2.0f;
+    float x2Inv = (x3+x2)/2.0f;
+    float y2Inv = (y3+y2)/2.0f;
+    float x3Inv = (x3+x1)/2.0f;
+    float y3Inv = (y3+y1)/2.0f;
+    SierpinskiTriangle subTriangles[3] = {
+        SierpinskiTriangle(x1, y1, x1Inv, y1Inv, x3Inv, y3Inv, 2),
+        SierpinskiTriangle(x1Inv, y1Inv, x2, y2, x2Inv, y2Inv, 2),
+        SierpinskiTriangle(x3, y3, x2Inv, y2Inv, x3Inv, y3Inv, 2)
+    };
+
+    // Each subtree holds the same number of subdivisions, so its place in the arrays is known up front.
+    // The colours drift over every subdivision before a subtree, so the drift alone is replayed once on
+    // this thread and each worker starts as soon as the colours of its first subdivision are known
+    long long subtreeGroups = (groups - 1) / 3;
+    int vertexFloats = indexed ? SIERPINSKI_INDEXED_VERTEX_FLOATS : SIERPINSKI_VERTEX_FLOATS;
+    int colourFloats = indexed ? SIERPINSKI_INDEXED_COLOUR_FLOATS : SIERPINSKI_COLOUR_FLOATS;
+    bool coloured = colours != 0 || instances != 0;
+    SierpinskiColours c(maxLevel);
+    long long drifted = 0;
+    thread workers[3];
+    for (int k = 0; k < 3; k++)
+    {
+        long long firstGroup = 1 + k * subtreeGroups;
+        for (; drifted < firstGroup && coloured; drifted++)
+        {
+            if (drifted % GEOMETRY_CANCEL_INTERVAL == 0 && GeometryCancelled(cancel))
+            {
+                break;
+            }
+            driftSierpinskiColours(&c, drifted);
+        }
+        workers[k] = thread(GenerateSierpinskiSubtree,
+            vertices != 0 ? vertices + firstGroup * vertexFloats : 0,
+            colours != 0 ? colours + firstGroup * colourFloats : 0,
+            instances != 0 ? instances + firstGroup : 0,
+            subTriangles[k], c, firstGroup, subtreeGroups, maxLevel, indexed, cancel);
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        workers[k].join();
+    }
+}
+
+// Fills the indices drawing the corners of every subdivision written by GenerateSierpinski() when
+// indexed, SIERPINSKI_INDICES for each of the groups
+void SetupIndexBufferSierpinski(long long groups, void *indices, int indexBytes)
+{
+    FillRepeatedIndices(indices, indexBytes, SIERPINSKI_SUBDIVISION_INDICES, SIERPINSKI_INDICES,
+        SIERPINSKI_INDEXED_VERTEX_FLOATS / 2, 0, groups);
+}
+
+// Writes the subdivisions of iteration maxLevel below one triangle, whose first subdivision is number
+// firstGroup of the whole triangle, run by a worker thread. Its colours start with c, those of that
+// subdivision. The iterations above are only walked to keep the colours drifting as they do when every
+// subdivision is written
+void GenerateSierpinskiLeavesSubtree(float *vertices, float *colours, SierpinskiTriangle t, SierpinskiColours c, long long firstGroup, int maxLevel, const GeometryCancel *cancel)
+{
+    int firstLevel = t.level;
+
+    vector<SierpinskiTriangle> pending;
+    pending.reserve(2 * (maxLevel - t.level) + 1);
+    pending.push_back(t);
+    for (long long i = firstGroup; !pending.empty(); i++)
+    {
+        t = pending.back();
+        pending.pop_back();
+        if ((t.level == firstLevel || t.level + GEOMETRY_CANCEL_LEVELS == maxLevel) && GeometryCancelled(cancel))
+        {
+            return;
+        }
+        SierpinskiTriangle inv = invertedTriangle(t);
+
+        if (t.level == maxLevel)
+        {
+            vertices = fillSubdivisionVertices(vertices, t, inv);
+            if (colours != 0)
+            {
+                colours = fillSubdivisionColours(colours, c);
+            }
+        }
+        else
+        {
+            pushSubTriangles(pending, t, inv);
+        }
+        driftSierpinskiColours(&c, i);
+    }
+}
+
+// Fills the preallocated vertex and colour arrays with only the 3^(maxLevel - 1) subdivisions of the
+// last iteration, in the order and with the colours GenerateSierpinski() gives them. Drawn after a
+// triangle of maxLevel - 1 iterations they cover the outer triangles of its last subdivisions, which
+// adds one iteration to it without generating the ones above again. Large levels are split between
+// threads like GenerateSierpinski(). Colours may be null when only the vertices are wanted
+void GenerateSierpinskiLeaves(float *vertices, float *colours, float x1, float y1, float x2, float y2, float x3, float y3, int maxLevel, const GeometryCancel *cancel)
+{
+    long long groups = SierpinskiGroupCount(maxLevel, 0);
+    if (groups < SIERPINSKI_PARALLEL_GROUPS)
+    {
+        GenerateSierpinskiLeavesSubtree(vertices, colours, SierpinskiTriangle(x1, y1, x2, y2, x3, y3, 1), SierpinskiColours(maxLevel), 0, maxLevel, cancel);
+        return;
+    }
+
+    SierpinskiTriangle inv = invertedTriangle(SierpinskiTriangle(x1, y1, x2, y2, x3, y3, 1));
+    SierpinskiTriangle subTriangles[3] = {
+        SierpinskiTriangle(x1, y1, inv.x1, inv.y1, inv.x3, inv.y3, 2),
+        SierpinskiTriangle(inv.x1, inv.y1, x2, y2, inv.x2, inv.y2, 2),
+        SierpinskiTriangle(x3, y3, inv.x2, inv.y2, inv.x3, inv.y3, 2)
+    };
+
+    // groups = (3^maxLevel - 1) / 2, each subtree holds a third of the subdivisions of the last iteration.
+    // As in GenerateSierpinski() the drift before each subtree is replayed once on this thread
+    long long subtreeGroups = (groups - 1) / 3;
+    long long subtreeLeaves = (2 * groups + 1) / 9;
+    SierpinskiColours c(maxLevel);
+    long long drifted = 0;
+    thread workers[3];
+    for (int k = 0; k < 3; k++)
+    {
+        long long firstGroup = 1 + k * subtreeGroups;
+        for (; drifted < firstGroup && colours != 0; drifted++)
+        {
+            if (drifted % GEOMETRY_CANCEL_INTERVAL == 0 && GeometryCancelled(cancel))
+            {
+                break;
+            }
+            driftSierpinskiColours(&c, drifted);
+        }
+        workers[k] = thread(GenerateSierpinskiLeavesSubtree,
+            vertices + k * subtreeLeaves * SIERPINSKI_VERTEX_FLOATS,
+            colours != 0 ? colours + k * subtreeLeaves * SIERPINSKI_COLOUR_FLOATS : 0,
+            subTriangles[k], c, firstGroup, maxLevel, cancel);
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        workers[k].join();
+    }
+}
+
+// --------------------------------------------------------------------------
+// Sierpinski point cloud from the chaos game
+
+// Number of points of the chaos game at a level, four times as many for every level, or -1 if
+// bytesPerPoint times that many do not fit in the Sierpinski memory limit or an int
+long long ChaosGamePointCount(int level, long long bytesPerPoint)
+{
+    long long points = CHAOS_GAME_BASE_POINTS;
+    for (int i = 1; i < level; i++)
+    {
+        points *= 4;
+        if (points * bytesPerPoint > sierpinskiMemoryLimit || points > INT_MAX)
+        {
+            return -1;
+        }
+    }
+    return points * bytesPerPoint > sierpinskiMemoryLimit ? -1 : points;
+}
+
+// Random bits for a step of a chunk, from its counter alone (the SplitMix64 finalizer), so that every
+// chunk gets the same stream whichever thread generates it
+inline unsigned long long chaosGameBits(unsigned long long chunk, unsigned long long step)
+{
+    unsigned long long z = ((chunk << 32) | step) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Picks one of the three corners from 32 random bits
+inline int chaosGameCorner(unsigned int bits)
+{
+    return (int)(((unsigned long long)bits * 3) >> 32);
+}
+
+// Plays the chaos game for one chunk of points: starting from a corner, every step moves halfway
+// towards a random corner. The colour moves halfway towards the colour of that corner too, so it
+// follows the subdivision the point lies in. The first steps are not kept, so that the points of a
+// chunk no longer cluster around the corner it started from
+void chaosGameChunk(float *vertices, float *colours, const float *cornerX, const float *cornerY,
+    const float (*cornerColours)[3], long long chunk, int count)
+{
+    const int WARM_UP_STEPS = 16;
+    unsigned long long step = 0;
+    unsigned long long bits = chaosGameBits(chunk, step++);
+    int k = chaosGameCorner((unsigned int)bits);
+    float x = cornerX[k];
+    float y = cornerY[k];
+    float red = cornerColours[k][0];
+    float green = cornerColours[k][1];
+    float blue = cornerColours[k][2];
+    for (int i = -WARM_UP_STEPS; i < count; i++)
+    {
+        // two steps out of every 64 random bits
+        if ((i & 1) == 0)
+        {
+            bits = chaosGameBits(chunk, step++);
+        }
+        else
+        {
+            bits >>= 32;
+        }
+        k = chaosGameCorner((unsigned int)bits);
+        x = (x + cornerX[k]) * 0.5f;
+        y = (y + cornerY[k]) * 0.5f;
+        red = (red + cornerColours[k][0]) * 0.5f;
+        green = (green + cornerColours[k][1]) * 0.5f;
+        blue = (blue + cornerColours[k][2]) * 0.5f;
+        if (i < 0)
+        {
+            continue;
+        }
+        vertices[2 * i] = x;
+        vertices[2 * i + 1] = y;
+        if (colours != 0)
+        {
+            colours[3 * i] = red;
+            colours[3 * i + 1] = green;
+            colours[3 * i + 2] = blue;
+        }
+    }
+}
+
+// Writes count points of the Sierpinski triangle with the given corners, and their colours unless
+// colours is null. The points are made in chunks of CHAOS_GAME_CHUNK_POINTS, each with random numbers
+// of its own, which the threads take in turn, so the points are the same for any number of threads.
+// The arrays are only written, so they may be mapped buffers
+void GenerateChaosGame(float *vertices, float *colours, long long count, float x1, float y1, float x2, float y2, float x3, float y3, int threads, const GeometryCancel *cancel)
+{
+    // red, cyan and blue like the outer triangles of the subdivided Sierpinski triangle
+    const float cornerX[3] = { x1, x2, x3 };
+    const float cornerY[3] = { y1, y2, y3 };
+    const float cornerColours[3][3] = { { 0.9f, 0.0f, 0.3f }, { 0.0f, 0.7f, 0.5f }, { 0.5f, 0.0f, 1.0f } };
+    long long chunks = (count + CHAOS_GAME_CHUNK_POINTS - 1) / CHAOS_GAME_CHUNK_POINTS;
+    threads = (int)max(1LL, min((long long)threads, chunks));
+
+    auto playChunks = [&](int first)
+    {
+        for (long long chunk = first; chunk < chunks && !GeometryCancelled(cancel); chunk += threads)
+        {
+            long long point = chunk * CHAOS_GAME_CHUNK_POINTS;
+            chaosGameChunk(vertices + 2 * point, colours != 0 ? colours + 3 * point : 0, cornerX, cornerY,
+                cornerColours, chunk, (int)min((long long)CHAOS_GAME_CHUNK_POINTS, count - point));
+        }
+    };
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(thread(playChunks, i));
+    }
+    playChunks(0);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+// --------------------------------------------------------------------------
+// Mesh files
+
+string MeshFileName(const string &directory, int part, int level, int variant)
+{
+    return directory + "/part" + to_string(part) + "_level" + to_string(level) + "_mode" + to_string(variant) + ".mesh";
+}
+
+// Rounds an offset up to the alignment of the arrays in a mesh file
+long long AlignMeshOffset(long long offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+// Pads the file with zeros up to offset and writes the array there
+void WriteMeshArray(ofstream &file, long long offset, const void *data, long long bytes)
+{
+    vector<char> padding(offset - file.tellp(), 0);
+    file.write(padding.data(), padding.size());
+    file.write((const char *)data, bytes);
+}
+
+// Writes the arrays after the header, filling in the magic, version and offsets of the header. Null
+// arrays are left out of the file. Returns false if the file could not be written
+bool WriteMeshFile(const string &filename, MeshFileHeader *header, const float *vertices, const float *colours, const SierpinskiInstance *instances)
+{
+    long long vertexBytes = vertices != 0 ? header->vertexCount * 2 * sizeof(float) : 0;
+    long long colourBytes = colours != 0 ? header->vertexCount * 3 * sizeof(float) : 0;
+    long long instanceBytes = instances != 0 ? header->instanceCount * sizeof(SierpinskiInstance) : 0;
+
+    memcpy(header->magic, MESH_FILE_MAGIC, sizeof(header->magic));
+    header->version = MESH_FILE_VERSION;
+    long long end = AlignMeshOffset(sizeof(MeshFileHeader));
+    header->vertexOffset = vertices != 0 ? end : 0;
+    end = AlignMeshOffset(end + vertexBytes);
+    header->colourOffset = colours != 0 ? end : 0;
+    end = AlignMeshOffset(end + colourBytes);
+    header->instanceOffset = instances != 0 ? end : 0;
+
+    ofstream file(filename.c_str(), ios::binary);
+    file.write((const char *)header, sizeof(MeshFileHeader));
+    if (vertices != 0)
+    {
+        WriteMeshArray(file, header->vertexOffset, vertices, vertexBytes);
+    }
+    if (colours != 0)
+    {
+        WriteMeshArray(file, header->colourOffset, colours, colourBytes);
+    }
+    if (instances != 0)
+    {
+        WriteMeshArray(file, header->instanceOffset, instances, instanceBytes);
+    }
+    return (bool)file;
+}
+
+// True if the array of the given size lies inside the mapped file at an aligned offset
+bool MeshArrayFits(const MappedMeshFile *mesh, long long offset, long long bytes)
+{
+    return offset == 0 || (offset % MESH_FILE_ALIGNMENT == 0 && offset <= mesh->size && bytes <= mesh->size - offset);
+}
+
+// Maps the whole file read only and checks that its header describes arrays inside it. Nothing is
+// read here: the pages are faulted in when the arrays are first used. Returns false if the file
+// does not exist or is not a mesh file of this version
+bool MapMeshFile(const string &filename, MappedMeshFile *mesh)
+{
+    int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < (off_t)sizeof(MeshFileHeader))
+    {
+        close(descriptor);
+        return false;
+    }
+    void *address = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (address == MAP_FAILED)
+    {
+        return false;
+    }
+    mesh->address = address;
+    mesh->size = status.st_size;
+    mesh->header = (const MeshFileHeader *)address;
+
+    // the arrays are handed over from start to end, so let the kernel read ahead
+    madvise(address, status.st_size, MADV_SEQUENTIAL);
+
+    const MeshFileHeader *header = mesh->header;
+    bool valid = memcmp(header->magic, MESH_FILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == MESH_FILE_VERSION && header->vertexCount >= 0 && header->instanceCount >= 0
+        && header->vertexCount <= INT_MAX && header->instanceCount <= INT_MAX
+        && MeshArrayFits(mesh, header->vertexOffset, header->vertexCount * 2 * sizeof(float))
+        && MeshArrayFits(mesh, header->colourOffset, header->vertexCount * 3 * sizeof(float))
+        && MeshArrayFits(mesh, header->instanceOffset, header->instanceCount * sizeof(SierpinskiInstance));
+    if (!valid)
+    {
+        UnmapMeshFile(mesh);
+    }
+    return valid;
+}
+
+void UnmapMeshFile(MappedMeshFile *mesh)
+{
+    if (mesh->address != 0)
+    {
+        munmap(mesh->address, mesh->size);
+    }
+    mesh->address = 0;
+    mesh->size = 0;
+    mesh->header = 0;
+}
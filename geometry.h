@@ -0,0 +1,169 @@
+// ==========================================================================
+// Geometry generators for the square and diamond, the spirals and the
+// Sierpinski triangle. Everything here only fills memory on the CPU, so it
+// can be built and benchmarked without an OpenGL context. The generators write
+// into memory sized by the caller and never read it back, so they can fill
+// mapped OpenGL buffers directly.
+// ==========================================================================
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+const long double PI = 3.141592653589793238L;
+
+// Lets another thread call off a generation nobody waits for any more: it is cancelled once latest no
+// longer holds the id of the request being generated. The long generators check it between Sierpinski
+// subtrees and between chunks of spiral colours, chaos game points or colour drift, and return early
+// with the rest of their arrays unwritten. A null pointer never cancels
+struct GeometryCancel
+{
+    const std::atomic<unsigned long> *latest;
+    unsigned long id;
+
+    GeometryCancel(const std::atomic<unsigned long> *latest, unsigned long id) : latest(latest), id(id)
+    {}
+};
+
+// Corners of a triangle still to be subdivided by the Sierpinski generator
+struct SierpinskiTriangle
+{
+    float x1, y1, x2, y2, x3, y3;
+    int level;
+
+    SierpinskiTriangle(float x1, float y1, float x2, float y2, float x3, float y3, int level)
+        : x1(x1), y1(y1), x2(x2), y2(y2), x3(x3), y3(y3), level(level)
+    {}
+};
+
+// Placement and colours of one subdivision when the Sierpinski triangle is drawn instanced
+struct SierpinskiInstance
+{
+    float offsetX, offsetY;     // left bottom corner of the subdivided triangle
+    float scale;                // size relative to the base triangle, negative when the corners
+                                // are listed from the top corner instead of the left bottom one
+    unsigned char red[4];       // colours of the three outer triangles, the inverted one is white
+    unsigned char cyan[4];
+    unsigned char blue[4];
+};
+
+// Every subdivision writes four triangles: 24 position and 36 colour floats
+const int SIERPINSKI_VERTEX_FLOATS = 24;
+const int SIERPINSKI_COLOUR_FLOATS = 36;
+const long long SIERPINSKI_BYTES_PER_GROUP = (SIERPINSKI_VERTEX_FLOATS + SIERPINSKI_COLOUR_FLOATS) * sizeof(float);
+// Drawn indexed every subdivision keeps its six corners, 12 position and 18 colour floats, and draws
+// its four triangles with 12 indices of up to four bytes
+const int SIERPINSKI_INDEXED_VERTEX_FLOATS = 12;
+const int SIERPINSKI_INDEXED_COLOUR_FLOATS = 18;
+const int SIERPINSKI_INDICES = 12;
+const long long SIERPINSKI_INDEXED_BYTES_PER_GROUP = (SIERPINSKI_INDEXED_VERTEX_FLOATS + SIERPINSKI_INDEXED_COLOUR_FLOATS
+    + SIERPINSKI_INDICES) * sizeof(float);
+// The colours of one subdivision, red, cyan and blue, stored to replay the drift from there
+const int SIERPINSKI_CHECKPOINT_FLOATS = 9;
+// Colours of the outermost square and diamond, every level inside is darker by the step
+const float SQUARE_COLOUR[3] = { 0.42f, 0.1f, 0.7f };
+const float DIAMOND_COLOUR[3] = { 0.58f, 0.9f, 0.3f };
+const float SQUARE_AND_DIAMOND_STEP = 0.08f;
+// Below this many vertices the spiral colours are not split between threads
+const int SPIRAL_PARALLEL_VERTICES = 1 << 16;
+// Every spiral sample draws a line of this length pointing away from the centre
+const float SPIRAL_SEGMENT_LENGTH = 0.01f;
+// Cancellation is checked before every Sierpinski subtree of this many iterations, and every this many
+// subdivisions, vertices or chunks of the generators that run through them in order
+const int GEOMETRY_CANCEL_LEVELS = 8;
+const int GEOMETRY_CANCEL_INTERVAL = 1 << 13;
+// Below this many subdivisions the generator does not start worker threads
+const long long SIERPINSKI_PARALLEL_GROUPS = 4096;
+// Largest vertex and colour data a Sierpinski triangle may generate, in bytes
+extern long long sierpinskiMemoryLimit;
+// The chaos game makes this many points at level 1 and four times as many for every further level,
+// in chunks of consecutive points with random numbers of their own
+const long long CHAOS_GAME_BASE_POINTS = 10000;
+const int CHAOS_GAME_CHUNK_POINTS = 1 << 16;
+
+bool GeometryCancelled(const GeometryCancel *cancel);
+
+// Vertex format conversions
+unsigned short FloatToHalf(float value);
+short FloatToSnorm16(float value);
+unsigned char NormalizedByte(float component);
+void PackVertices(unsigned char *packed, const float *vertices, const float *colours, int count, bool halfFloats);
+
+// Index buffers
+int IndexBytes(long long vertexCount);
+void FillRepeatedIndices(void *indices, int indexBytes, const unsigned char *pattern, int patternLength, int groupVertices, long long first, long long count);
+
+// Square and diamond
+int SquareAndDiamondVertexCount(int maxLevel);
+int SquareAndDiamondIndexedVertexCount(int maxLevel);
+void SetupVertexBufferSquareAndDiamond(int firstLevel, int maxLevel, float *vertices, bool indexed);
+void SetupIndexBufferSquareAndDiamond(int firstLevel, int maxLevel, void *indices, int indexBytes);
+void SetupColourBufferSquareAndDiamond(int firstLevel, int maxLevel, float *colours, bool indexed);
+
+// Spiral
+int SpiralSampleCount(int level);
+void SpiralSteps(int level, float *radiusStep, float *angleStep);
+void EvaluateSpiral(float *vertices, int level);
+void AssignSpiralColours(float *colours, int level, const GeometryCancel *cancel);
+void AdaptiveSpiralSamples(int level, float pixelsPerUnit, float targetPixels, std::vector<float> *samples);
+void EvaluateSpiralSamples(float *vertices, const float *samples, int count, int level);
+void AssignSpiralSampleColours(float *colours, const float *samples, int count, int level);
+void StackedSpiralReference(int level, std::vector<float> *vertices, std::vector<float> *colours);
+
+// Sierpinski triangle
+long long SierpinskiGroupCount(int maxLevel, long long bytesPerGroup);
+void renderTriangleLevel(float *vertices, SierpinskiInstance *instances, float x1, float y1, float x2, float y2, float x3, float y3, int level, int maxLevel, bool indexed, const GeometryCancel *cancel);
+void assignColoursToLevelSierpinski(float *colours, SierpinskiInstance *instances, long long firstGroup, long long groupCount, int maxLevel, bool indexed, const GeometryCancel *cancel);
+void GenerateSierpinski(float *vertices, float *colours, SierpinskiInstance *instances, float x1, float y1, float x2, float y2, float x3, float y3, int maxLevel, bool indexed, const GeometryCancel *cancel);
+void SetupIndexBufferSierpinski(long long groups, void *indices, int indexBytes);
+void SierpinskiColourCheckpoints(float *checkpoints, long long groups, int maxLevel, int interval);
+void SierpinskiColourFactors(int maxLevel, float *factor, double *factorSquared);
+void GenerateSierpinskiLeaves(float *vertices, float *colours, float x1, float y1, float x2, float y2, float x3, float y3, int maxLevel, const GeometryCancel *cancel);
+
+// Sierpinski point cloud from the chaos game
+long long ChaosGamePointCount(int level, long long bytesPerPoint);
+void GenerateChaosGame(float *vertices, float *colours, long long count, float x1, float y1, float x2, float y2, float x3, float y3, int threads, const GeometryCancel *cancel);
+
+// Mesh files keep the generated arrays of one shape so that deep levels can be loaded instead of
+// generated again. The header is followed by the positions, colours and instances, each starting at a
+// multiple of MESH_FILE_ALIGNMENT so that they can be used in place once the file is memory mapped.
+// Everything is stored in the byte order of the machine that wrote the file
+const char MESH_FILE_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+const unsigned int MESH_FILE_VERSION = 1;
+const long long MESH_FILE_ALIGNMENT = 4096;
+
+struct MeshFileHeader
+{
+    char magic[4];
+    unsigned int version;
+    int part;
+    int level;
+    int variant;                // render path of the part the arrays were generated for
+    unsigned int drawMode;      // OpenGL primitive the vertices are drawn as
+    long long vertexCount;
+    long long instanceCount;
+    long long vertexOffset;     // two floats per vertex, from the start of the file, zero when absent
+    long long colourOffset;     // three floats per vertex, zero when the shader computes the colours
+    long long instanceOffset;   // one SierpinskiInstance each, zero when absent
+};
+
+// A mesh file mapped read only into memory, the arrays are read straight from its pages
+struct MappedMeshFile
+{
+    void *address;
+    long long size;
+    const MeshFileHeader *header;
+
+    MappedMeshFile() : address(0), size(0), header(0)
+    {}
+};
+
+std::string MeshFileName(const std::string &directory, int part, int level, int variant);
+bool WriteMeshFile(const std::string &filename, MeshFileHeader *header, const float *vertices, const float *colours, const SierpinskiInstance *instances);
+bool MapMeshFile(const std::string &filename, MappedMeshFile *mesh);
+void UnmapMeshFile(MappedMeshFile *mesh);
+
+#endif
@@ -18,19 +18,88 @@
 #include <cmath>
 #include <typeinfo>
 #include <vector>
+#include <cstdlib>
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 // specify that we want the OpenGL core profile before including GLFW headers
 #define GLFW_INCLUDE_GLCOREARB
 #define GL_GLEXT_PROTOTYPES
 #include <GLFW/glfw3.h>
 
+// the OpenGL headers of macOS stop at version 4.1, which has no pipeline statistics queries
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+
+// nor any debug output, which came with OpenGL 4.3 and KHR_debug, so its entry points are looked up at runtime
+#ifndef GL_DEBUG_OUTPUT
+#define GL_DEBUG_OUTPUT                   0x92E0
+#define GL_DEBUG_SOURCE_API               0x8246
+#define GL_DEBUG_SOURCE_WINDOW_SYSTEM     0x8247
+#define GL_DEBUG_SOURCE_SHADER_COMPILER   0x8248
+#define GL_DEBUG_SOURCE_THIRD_PARTY       0x8249
+#define GL_DEBUG_SOURCE_APPLICATION       0x824A
+#define GL_DEBUG_TYPE_ERROR               0x824C
+#define GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR 0x824D
+#define GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR  0x824E
+#define GL_DEBUG_TYPE_PORTABILITY         0x824F
+#define GL_DEBUG_TYPE_PERFORMANCE         0x8250
+#define GL_DEBUG_SEVERITY_HIGH            0x9146
+#define GL_DEBUG_SEVERITY_MEDIUM          0x9147
+#define GL_DEBUG_SEVERITY_LOW             0x9148
+#define GL_DEBUG_SEVERITY_NOTIFICATION    0x826B
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+typedef void (APIENTRY *DebugOutputFunction)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+    const GLchar *message, const void *userParam);
+typedef void (APIENTRY *DebugMessageCallbackFunction)(DebugOutputFunction callback, const void *userParam);
+typedef void (APIENTRY *DebugMessageControlFunction)(GLenum source, GLenum type, GLenum severity, GLsizei count,
+    const GLuint *ids, GLboolean enabled);
+
+// compute shaders came with OpenGL 4.3 as well
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER                  0x91B9
+#define GL_SHADER_STORAGE_BUFFER           0x90D2
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_BUFFER_UPDATE_BARRIER_BIT       0x00000200
+#endif
+typedef void (APIENTRY *DispatchComputeFunction)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRY *MemoryBarrierFunction)(GLbitfield barriers);
+
+#include "geometry.h"
+
 using namespace std;
 
 // GLOBAL VARIABLES
-const long double PI = 3.141592653589793238L;
 int PART = 1;   // Specifies which part of the assignment is: 1 for A (Square and Diamond)
                 //, 2 for B (Spiral) and 3 for C (Sierinski Triangle)
-int LEVEL = 1;  // It refers to the number of iterations or revolutions of the shape, it goes from 1 to 6
+int LEVEL = 1;  // It refers to the number of iterations or revolutions of the shape, it starts from 1
+int SQUARE_MODE = 1;        // How the square and diamond are drawn: 1 for one vertex array with every
+                            // triangle, 2 for their corners drawn through an index buffer
+const int NUMBER_OF_SQUARE_MODES = 2;
+int SIERPINSKI_MODE = 1;    // How the Sierpinski triangle is drawn: 1 for one vertex array with every
+                            // triangle, 2 for instances of one subdivided triangle, 3 for triangles
+                            // generated in the vertex shader without any vertex buffer, 4 for the
+                            // corners of each subdivision drawn through an index buffer, 5 for a
+                            // cloud of points sampled by the chaos game
+const int NUMBER_OF_SIERPINSKI_MODES = 5;
+int SPIRAL_MODE = 1;        // Where the spiral colours come from: 1 for a colour buffer, 2 for the vertex shader,
+                            // 3 for a colour buffer with the samples spaced for the framebuffer size
+const int NUMBER_OF_SPIRAL_MODES = 3;
+int VERTEX_FORMAT = 1;      // How vertex arrays are stored: 1 for separate float buffers, 2 for interleaved half
+                            // float positions and byte colours, 3 for interleaved 16 bit integer positions,
+                            // 4 for float positions alone with the colours computed by the vertex shader
+const int NUMBER_OF_VERTEX_FORMATS = 4;
 
 struct MyShader
 {
@@ -44,57 +113,320 @@ struct MyShader
     {}
 };
 MyShader shader;
+MyShader instancedShader;   // draws instances of one subdivided Sierpinski triangle
+MyShader proceduralShader;  // generates the Sierpinski triangle from gl_VertexID
+MyShader spiralShader;      // computes the spiral colour ramp from gl_VertexID
+MyShader flatShader;        // colours each triangle with its last vertex, for corners shared by several colours
+MyShader galleryShader;     // moves each shape of the gallery into its own tile
+MyShader subdivisionShader; // adds an iteration to a Sierpinski triangle with transform feedback
+MyShader paletteShader;     // computes the square and diamond and Sierpinski colours from gl_VertexID
+GLuint paletteBuffer = 0;   // uniform buffer of its Palette block
+
+// Sierpinski colours of vertex_palette.glsl at every PALETTE_CHECKPOINT_INTERVAL-th subdivision of the
+// triangles of one to levels iterations, one after the other, in a texture buffer that stays bound to
+// PALETTE_CHECKPOINT_UNIT. The floats are kept so deeper levels are only appended
+struct PaletteCheckpoints
+{
+    GLuint buffer;
+    GLuint texture;
+    int levels;
+    vector<GLfloat> floats;
+
+    PaletteCheckpoints() : buffer(0), texture(0), levels(0) {}
+};
+PaletteCheckpoints paletteCheckpoints;
+const int PALETTE_CHECKPOINT_INTERVAL = 16;
+const GLuint PALETTE_CHECKPOINT_UNIT = 2;   // SubdivideCacheEntry() borrows units 0 and 1
+string shaderCacheDirectory = "shader_cache";  // where linked program binaries are kept, empty to always compile
+int programsRequested = 0;     // programs the Initialize functions were asked for, counted with those from the cache
+int programsFromCache = 0;
 
 struct MyGeometry
 {
     // OpenGL names for array buffer objects, vertex array object
     GLuint  vertexBuffer;
     GLuint  colourBuffer;
+    GLuint  instanceBuffer;
+    GLuint  elementBuffer;      // indices into the vertices, zero when they are drawn in order
     GLuint  vertexArray;
-    GLsizei elementCount;
+    GLsizei elementCount;       // vertices drawn, or indices when there is an element buffer
+    GLsizei vertexCount;        // vertices stored in the buffers
+    GLenum  indexType;          // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT for the element buffer
+    GLsizei instanceCount;      // zero when the geometry is not drawn instanced
+    GLuint  program;            // shader program to draw with, zero for the default one
+    int     level;              // passed as the Level uniform to programs that generate the shape
+    int     palette;            // part passed to vertex_palette.glsl when it computes the colours, else zero
+    int     format;             // vertex format of the vertex array, see VertexFormatName()
+    GLsizeiptr bufferBytes;     // total bytes uploaded into the buffers above
+    double  uploadSeconds;      // time spent handing those bytes to OpenGL
 
     // initialize object names to zero (OpenGL reserved value)
-    MyGeometry() : vertexBuffer(0), colourBuffer(0), vertexArray(0), elementCount(0)
+    MyGeometry() : vertexBuffer(0), colourBuffer(0), instanceBuffer(0), elementBuffer(0), vertexArray(0),
+        elementCount(0), vertexCount(0), indexType(0), instanceCount(0), program(0), level(0), palette(0),
+        format(1), bufferBytes(0), uploadSeconds(0.0)
     {}
 };
 
 MyGeometry geometry;
 GLuint renderMode;
 
+// Arrays of a shape on the CPU that still have to be uploaded, with the counts of the shape. The arrays
+// either belong to the vectors below or point into a memory mapped mesh file, and are null when the
+// Generate functions wrote them straight into mapped buffers or the vertex shader computes them
+struct GeometryData
+{
+    const GLfloat *vertices;    // two position floats per vertex
+    const GLfloat *colours;     // three colour floats per vertex
+    GLsizei vertexCount;
+    const SierpinskiInstance *instances;
+    GLsizei instanceCount;
+    const void *indices;        // indexBytes per index, null when the vertices are drawn in order
+    GLsizei indexCount;
+    int indexBytes;
+    vector<GLfloat> vertexArray;
+    vector<GLfloat> colourArray;
+    vector<SierpinskiInstance> instanceArray;
+    vector<GLubyte> indexArray;
+
+    GeometryData() : vertices(0), colours(0), vertexCount(0), instances(0), instanceCount(0), indices(0),
+        indexCount(0), indexBytes(0)
+    {}
+};
+
+// Where the Generate functions write a shape: into the vectors of the data, to be uploaded later by a
+// thread owning the context, or, when geometry is set, straight into buffers of the geometry mapped for
+// writing, which needs a current context on the generating thread. The packed vertex formats are
+// converted from floats, so their arrays always go through the vectors
+struct GeometrySink
+{
+    GeometryData *data;
+    MyGeometry *geometry;       // buffers to map, null to generate into the vectors
+    int format;
+    bool computed;              // the buffers were written by compute shaders instead of being mapped
+    const GeometryCancel *cancel;   // stops the generators once nobody waits for the shape, null to always finish
+
+    GeometrySink(GeometryData *data, MyGeometry *geometry, int format) : data(data), geometry(geometry), format(format),
+        computed(false), cancel(0)
+    {}
+};
+bool mappedGeometrySink = true; // generate into mapped buffers wherever a context is current
+string meshDirectory;           // where pregenerated mesh files are loaded from, empty to always generate
+// The adaptive spiral is sampled for the longer side of the framebuffer, which the builder thread reads
+atomic<int> framebufferPixels(512);
+float spiralSegmentPixels = 0.7f;   // screen distance between the outer ends of adaptive spiral segments
+
+// Built geometry stays resident for each (part, level) pair so that switching
+// between scenes only rebinds a vertex array instead of rebuilding it
+struct CacheEntry
+{
+    int part;
+    int level;
+    int lowestLevel;            // levels from this one up to level are drawn from a prefix of the buffers
+    int variant;                // render path of the part, see GeometryVariant()
+    int format;                 // vertex format, see GeometryFormat()
+    int pixels;                 // framebuffer size the shape was sampled for, see GeometryPixels()
+    MyGeometry geometry;
+    GLuint renderMode;
+    unsigned long lastUsed;     // value of the cache clock when last displayed
+};
+
+struct GeometryCache
+{
+    vector<CacheEntry> entries;
+    GLsizeiptr budgetBytes;     // least recently used entries are evicted above this
+    GLsizeiptr residentBytes;
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long meshLoads;    // misses uploaded from a mesh file instead of being generated
+    unsigned long levelSteps;   // misses built by appending levels to a cached entry
+    int warmupNext;             // next (part, level) combination to prebuild, -1 when idle
+
+    GeometryCache() : budgetBytes(64 * 1024 * 1024), residentBytes(0), clock(0),
+        hits(0), misses(0), evictions(0), meshLoads(0), levelSteps(0), warmupNext(-1)
+    {}
+};
+GeometryCache cache;
+
+const int NUMBER_OF_PARTS = 3;
+const int NUMBER_OF_LEVELS = 6;
+
+// OpenGL errors are reported by the debug output callback where the driver has KHR_debug, otherwise
+// every frame polls glGetError. Release builds (-DRELEASE) do neither, see CheckFrameErrors()
+bool debugOutput = false;
+bool pollFrameErrors = true;
+mutex debugOutputLock;          // the driver may call back from threads of its own
+
+// With --compute-geometry and an OpenGL 4.3 context, spirals and Sierpinski triangles in the float vertex
+// format are generated by compute shaders straight into their buffers instead of on the CPU. The programs
+// and their uniforms are shared by the contexts of both threads, so one dispatch is set up at a time
+struct ComputeGeometry
+{
+    bool enabled;
+    MyShader spiral;
+    MyShader sierpinski;
+    DispatchComputeFunction dispatch;
+    MemoryBarrierFunction barrier;
+    mutex lock;
+
+    ComputeGeometry() : enabled(false), dispatch(0), barrier(0)
+    {}
+};
+ComputeGeometry computeGeometry;
+const int COMPUTE_GROUP_SIZE = 64;          // local_size_x of the compute programs
+const int COMPUTE_MAX_GROUPS = 65535;       // work groups every implementation can dispatch at once
+const int COMPUTE_SIERPINSKI_RUN = 64;      // subdivisions written by one invocation, see compute_sierpinski.glsl
+
+// With --gpu-subdivision a cached Sierpinski triangle in the float vertex format steps up a level with one
+// transform feedback pass of subdivisionShader, instead of generating the new level on the builder thread
+bool gpuSubdivision = false;
+const int SUBDIVISION_CHECKPOINT_INTERVAL = 16; // subdivisions between the colours handed to vertex_subdivide.glsl
+
 // END OF GLOBAL VARIABLES
 // --------------------------------------------------------------------------
 // OpenGL utility and support function prototypes
 
 void QueryGLVersion();
 bool CheckGLErrors();
+void CheckFrameErrors();
+bool EnableDebugOutput();
 
 // Function Prototypes
 string LoadSource(const string &filename);
 GLuint CompileShader(GLenum shaderType, const string &source);
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, const vector<const GLchar *> &feedbackVaryings);
+unsigned long long HashString(unsigned long long hash, const string &text);
+GLuint LoadProgramBinary(const string &filename, unsigned long long key);
+void SaveProgramBinary(GLuint program, const string &filename, unsigned long long key);
+void DestroyGeometry(MyGeometry *geometry);
+bool ExtendPaletteCheckpoints(int level);
 
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL shader programs for rendering
 
-// load, compile, and link shaders, returning true if successful
-bool InitializeShaders(MyShader *shader)
+// load, compile, and link shaders, returning true if successful. Linked programs are kept in the
+// program binary cache, keyed by their sources and the driver, so later runs skip compiling them
+bool InitializeShaders(MyShader *shader, const string &vertexFilename, const string &fragmentFilename)
 {
     // load shader source from files
-    string vertexSource = LoadSource("vertex.glsl");
-    string fragmentSource = LoadSource("fragment.glsl");
+    programsRequested++;
+    string vertexSource = LoadSource(vertexFilename);
+    string fragmentSource = LoadSource(fragmentFilename);
     if (vertexSource.empty() || fragmentSource.empty()) return false;
 
+    // a binary only fits the driver that produced it
+    string cacheFile;
+    unsigned long long key = 0;
+    if (!shaderCacheDirectory.empty())
+    {
+        cacheFile = shaderCacheDirectory + "/" + vertexFilename + ".bin";
+        key = HashString(key, vertexSource);
+        key = HashString(key, fragmentSource);
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+        shader->program = LoadProgramBinary(cacheFile, key);
+        if (shader->program != 0)
+        {
+            programsFromCache++;
+            return !CheckGLErrors();
+        }
+    }
+
     // compile shader source into shader objects
     shader->vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
     shader->fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
 
     // link shader program
-    shader->program = LinkProgram(shader->vertex, shader->fragment);
+    shader->program = LinkProgram(shader->vertex, shader->fragment, vector<const GLchar *>());
+    if (!cacheFile.empty())
+    {
+        SaveProgramBinary(shader->program, cacheFile, key);
+    }
 
     // check for OpenGL errors and return false if error occurred
     return !CheckGLErrors();
 }
 
+// load, compile, and link a compute program, returning true if successful. The compute shader takes the
+// place of the vertex shader and there is no fragment shader; the program binary cache is used as above
+bool InitializeComputeShader(MyShader *shader, const string &filename)
+{
+    programsRequested++;
+    string source = LoadSource(filename);
+    if (source.empty()) return false;
+
+    string cacheFile;
+    unsigned long long key = 0;
+    if (!shaderCacheDirectory.empty())
+    {
+        cacheFile = shaderCacheDirectory + "/" + filename + ".bin";
+        key = HashString(key, source);
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+        shader->program = LoadProgramBinary(cacheFile, key);
+        if (shader->program != 0)
+        {
+            programsFromCache++;
+            return !CheckGLErrors();
+        }
+    }
+
+    shader->vertex = CompileShader(GL_COMPUTE_SHADER, source);
+    shader->program = LinkProgram(shader->vertex, 0, vector<const GLchar *>());
+    if (!cacheFile.empty())
+    {
+        SaveProgramBinary(shader->program, cacheFile, key);
+    }
+
+    // check for OpenGL errors and return false if error occurred
+    GLint status;
+    glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+    return !CheckGLErrors() && status == GL_TRUE;
+}
+
+// load, compile, and link a vertex program whose outputs are captured by transform feedback, one
+// buffer for each of the varyings, returning true if successful. There is no fragment shader since
+// nothing is rasterized; the program binary cache is used as above
+bool InitializeFeedbackShader(MyShader *shader, const string &filename, const vector<const GLchar *> &varyings)
+{
+    programsRequested++;
+    string source = LoadSource(filename);
+    if (source.empty()) return false;
+
+    string cacheFile;
+    unsigned long long key = 0;
+    if (!shaderCacheDirectory.empty())
+    {
+        cacheFile = shaderCacheDirectory + "/" + filename + ".bin";
+        key = HashString(key, source);
+        for (size_t i = 0; i < varyings.size(); i++)
+        {
+            key = HashString(key, varyings[i]);
+        }
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+        key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+        shader->program = LoadProgramBinary(cacheFile, key);
+        if (shader->program != 0)
+        {
+            programsFromCache++;
+            return !CheckGLErrors();
+        }
+    }
+
+    shader->vertex = CompileShader(GL_VERTEX_SHADER, source);
+    shader->program = LinkProgram(shader->vertex, 0, varyings);
+    if (!cacheFile.empty())
+    {
+        SaveProgramBinary(shader->program, cacheFile, key);
+    }
+
+    // check for OpenGL errors and return false if error occurred
+    GLint status;
+    glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+    return !CheckGLErrors() && status == GL_TRUE;
+}
+
 // deallocate shader-related objects
 void DestroyShaders(MyShader *shader)
 {
@@ -107,461 +439,989 @@ void DestroyShaders(MyShader *shader)
 
 
 // --------------------------------------------------------------------------
-// Functions to set up OpenGL buffers for storing geometry data
+// Frame instrumentation: GPU timers around the clear and the draw of every
+// frame, CPU timers around generating, uploading and setting up geometry, and
+// counters of the vertices and buffers involved
 
-// -------------------------------------------------------------------------
-// Functions related to the Square and Diamond
-
-// Fills the geometry data taking into account the numbers of levels
-void SetupVertexBufferSquareAndDiamond(int maxLevel, MyGeometry *geometry) 
+// Totals since startup, added to by the render and builder threads alike. Each frame is charged
+// with what was added between the end of the previous frame and its own end
+struct GeometryCounters
 {
-    // Base shape for all levels
-    vector<GLfloat> vertices;
+    atomic<long long> generateNanoseconds;  // filling the arrays of shapes, mapped or not
+    atomic<long long> uploadNanoseconds;    // handing arrays to OpenGL and copying buffers on the GPU
+    atomic<long long> setupNanoseconds;     // creating the vertex arrays of uploaded shapes
+    atomic<long long> verticesGenerated;
+    atomic<long long> bytesUploaded;
+    atomic<long long> buffersAllocated;
+    atomic<long long> buffersFreed;
+    atomic<long long> adaptiveSpiralVertices;   // vertices of the spirals sampled for the framebuffer size
+    atomic<long long> fixedStepSpiralVertices;  // vertices the fixed step would have given those spirals
 
-    // Number of vertices in current level
-    int counter = 0;
-    while (counter < maxLevel)
-    {
-        float factor = (1/pow(2, counter));
-        vertices.push_back(-1.0 * factor); // Square vertices
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(1.0 * factor);
-
-        vertices.push_back(0.0 * factor); // Diamond vertices
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(0.0 * factor);
-        vertices.push_back(0.0 * factor);
-        vertices.push_back(1.0 * factor);
-        vertices.push_back(0.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(-1.0 * factor);
-        vertices.push_back(0.0 * factor);
-        vertices.push_back(0.0 * factor);
-        vertices.push_back(1.0 * factor);
-
-       counter++;
-    }
-
-    // Placing the data into the buffer
-    geometry->elementCount = vertices.size()/2;
-    glGenBuffers(1, &geometry->vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
-}
+    GeometryCounters() : generateNanoseconds(0), uploadNanoseconds(0), setupNanoseconds(0), verticesGenerated(0),
+        bytesUploaded(0), buffersAllocated(0), buffersFreed(0), adaptiveSpiralVertices(0), fixedStepSpiralVertices(0)
+    {}
+};
+GeometryCounters counters;
+const int COUNTER_TOTALS = 9;       // counters above charged to the frame they change in
 
-// Generates the colour for the square and diamond and binds this data to the buffer
-void SetupColourBufferSquareAndDiamond(int maxLevel, MyGeometry *geometry) 
+const int GPU_CLEAR = 0;            // phases of a frame timed on the GPU
+const int GPU_DRAW = 1;
+const int GPU_PHASES = 2;
+const int TIMER_FRAMES = 2;         // sets of timer queries, alternate frames use alternate sets
+const int STATS_WINDOW = 120;       // frames summarized by the rolling window
+
+// What one frame cost. GPU times are known two frames later, when the set of queries is reused
+struct FrameRecord
 {
-    float red = 0.42;
-    float green = 0.1;
-    float blue = 0.7f;
-    float diamondRed = 0.58;
-    float diamondGreen = 0.9f;
-    float diamondBlue = 0.3f;
-    // Base colour for level
-    vector<GLfloat> colours;
-    for (int i = 0; i < 6; i++)
-    {
-        colours.push_back(red);
-        colours.push_back(green);
-        colours.push_back(blue);
-    }
-    for (int j = 0; j < 6; j++)
+    unsigned long frame;
+    double time;                    // glfwGetTime() at the start of the frame
+    double cpuMilliseconds;         // from the start of the frame to the buffer swap
+    double gpuMilliseconds[GPU_PHASES];     // negative until read back, or if the result came too late
+    double generateMilliseconds;
+    double uploadMilliseconds;
+    double setupMilliseconds;
+    long long verticesGenerated;
+    long long verticesDrawn;
+    long long bytesUploaded;
+    long long buffersAllocated;
+    long long buffersFreed;
+    long long adaptiveSpiralVertices;
+    long long fixedStepSpiralVertices;
+
+    FrameRecord() : frame(0), time(0.0), cpuMilliseconds(0.0), generateMilliseconds(0.0), uploadMilliseconds(0.0),
+        setupMilliseconds(0.0), verticesGenerated(0), verticesDrawn(0), bytesUploaded(0), buffersAllocated(0),
+        buffersFreed(0), adaptiveSpiralVertices(0), fixedStepSpiralVertices(0)
     {
-        colours.push_back(diamondRed);
-        colours.push_back(diamondGreen);
-        colours.push_back(diamondBlue);
+        gpuMilliseconds[GPU_CLEAR] = -1.0;
+        gpuMilliseconds[GPU_DRAW] = -1.0;
     }
-    int counter = 1;
+};
+
+// Timer queries of the frames in flight, the rolling window of the last frames and the CSV trace. The
+// result of a query is only read once its set comes round again, and only if it is available, so the
+// CPU never waits for the GPU. Timers only run between BeginFrameStats() and EndFrameStats(), which
+// keeps them out of the offscreen benchmark and its own queries
+struct FrameStats
+{
+    GLuint queries[TIMER_FRAMES][GPU_PHASES];
+    bool issued[TIMER_FRAMES][GPU_PHASES];
+    unsigned long queryFrame[TIMER_FRAMES];     // frame that used each set
+    bool pending[TIMER_FRAMES];                 // whether that frame still waits for its results
+    bool inFrame;
+    unsigned long frames;                       // frames ended so far
+    unsigned long lateTimers;                   // results not available when their set was reused
+    FrameRecord current;
+    FrameRecord window[STATS_WINDOW];           // indexed by frame modulo the window size
+    long long totals[COUNTER_TOTALS];           // of the counters at the end of the last frame
+    ofstream trace;                             // CSV with a row per frame, written while open
+    string traceFilename;
 
-    float step = 0.08f;
-    while (counter <= maxLevel)
+    FrameStats() : inFrame(false), frames(0), lateTimers(0), traceFilename("frame_trace.csv")
     {
-        red = red - step;
-        green = green - step;
-        blue = blue - step;
-        diamondRed = diamondRed - step;
-        diamondGreen = diamondGreen - step;
-        diamondBlue = diamondBlue - step;
-        for (int i = 0; i < 6; i++)
+        for (int i = 0; i < TIMER_FRAMES; i++)
         {
-            colours.push_back(red);
-            colours.push_back(green);
-            colours.push_back(blue);
+            queryFrame[i] = 0;
+            pending[i] = false;
+            for (int phase = 0; phase < GPU_PHASES; phase++)
+            {
+                queries[i][phase] = 0;
+                issued[i][phase] = false;
+            }
         }
-        for (int j = 0; j < 6; j++)
+        for (int i = 0; i < COUNTER_TOTALS; i++)
         {
-            colours.push_back(diamondRed);
-            colours.push_back(diamondGreen);
-            colours.push_back(diamondBlue);
+            totals[i] = 0;
         }
-        counter++;
     }
+};
+FrameStats frameStats;
 
-    // create another one for storing our colours
-    glGenBuffers(1, &geometry->colourBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glBufferData(GL_ARRAY_BUFFER, colours.size() * sizeof(GLfloat), colours.data(), GL_STATIC_DRAW);
+void AddSeconds(atomic<long long> *nanoseconds, double seconds)
+{
+    *nanoseconds += (long long)(seconds * 1.0e9);
 }
 
-// Create buffers and fill with geometry data, returning true if successful
-bool InitializeSquareAndDiamond(MyGeometry *geometry)
-{   
-    const GLuint VERTEX_INDEX = 0;
-    const GLuint COLOUR_INDEX = 1;
-    // Generate arrays with data for the level
-    SetupVertexBufferSquareAndDiamond(LEVEL, geometry);
-    SetupColourBufferSquareAndDiamond(LEVEL, geometry);
-
-    // create a vertex array object encapsulating all our vertex attributes
-    glGenVertexArrays(1, &geometry->vertexArray);
-    glBindVertexArray(geometry->vertexArray);
-
-    // associate the position array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glVertexAttribPointer(VERTEX_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(VERTEX_INDEX);
+void StartFrameStats(FrameStats *stats)
+{
+    glGenQueries(TIMER_FRAMES * GPU_PHASES, &stats->queries[0][0]);
+}
 
-    // associate the colour array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glVertexAttribPointer(COLOUR_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(COLOUR_INDEX);
-    // unbind our buffers, resetting to default state
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+void WriteFrameTrace(FrameStats *stats, const FrameRecord &record)
+{
+    if (!stats->trace.is_open())
+    {
+        return;
+    }
+    stats->trace << record.frame << "," << record.time << "," << record.cpuMilliseconds << ","
+                 << record.gpuMilliseconds[GPU_CLEAR] << "," << record.gpuMilliseconds[GPU_DRAW] << ","
+                 << record.generateMilliseconds << "," << record.uploadMilliseconds << "," << record.setupMilliseconds << ","
+                 << record.verticesGenerated << "," << record.verticesDrawn << "," << record.bytesUploaded << ","
+                 << record.buffersAllocated << "," << record.buffersFreed << "," << record.adaptiveSpiralVertices << ","
+                 << record.fixedStepSpiralVertices << "\n";
+}
 
-    // check for OpenGL errors and return false if error occurred
-    return !CheckGLErrors();
+// Reads the GPU times of the frame that used a set of queries into its record and writes its trace row.
+// Unless told to wait, results that are not available yet are given up, leaving those times negative
+void ResolveFrameTimers(FrameStats *stats, int set, bool wait)
+{
+    if (!stats->pending[set])
+    {
+        return;
+    }
+    FrameRecord *record = &stats->window[stats->queryFrame[set] % STATS_WINDOW];
+    for (int phase = 0; phase < GPU_PHASES; phase++)
+    {
+        if (!stats->issued[set][phase])
+        {
+            continue;
+        }
+        stats->issued[set][phase] = false;
+        GLint available = GL_TRUE;
+        if (!wait)
+        {
+            glGetQueryObjectiv(stats->queries[set][phase], GL_QUERY_RESULT_AVAILABLE, &available);
+        }
+        if (!available)
+        {
+            stats->lateTimers++;
+            continue;
+        }
+        GLuint64 nanoseconds;
+        glGetQueryObjectui64v(stats->queries[set][phase], GL_QUERY_RESULT, &nanoseconds);
+        record->gpuMilliseconds[phase] = nanoseconds * 1.0e-6;
+    }
+    stats->pending[set] = false;
+    WriteFrameTrace(stats, *record);
 }
 
+// Called at the start of every frame of the window, before anything is uploaded or drawn
+void BeginFrameStats(FrameStats *stats)
+{
+    ResolveFrameTimers(stats, stats->frames % TIMER_FRAMES, false);
+    stats->current = FrameRecord();
+    stats->current.frame = stats->frames;
+    stats->current.time = glfwGetTime();
+    stats->inFrame = stats->queries[0][0] != 0;
+}
 
-// Deallocate geometry-related objects
-void DestroyGeometry(MyGeometry *geometry)
+// Times a phase of the frame on the GPU until EndGpuTimer(), nothing happens outside a frame
+void BeginGpuTimer(FrameStats *stats, int phase)
 {
-    // unbind and destroy our vertex array object and associated buffers
-    glBindVertexArray(0);
-    glDeleteVertexArrays(1, &geometry->vertexArray);
-    glDeleteBuffers(1, &geometry->vertexBuffer);
-    glDeleteBuffers(1, &geometry->colourBuffer);
+    if (stats->inFrame)
+    {
+        int set = stats->frames % TIMER_FRAMES;
+        glBeginQuery(GL_TIME_ELAPSED, stats->queries[set][phase]);
+        stats->issued[set][phase] = true;
+    }
 }
 
-// --------------------------------------------------------------------------
-// Rendering function that draws our scene to the frame buffer
+void EndGpuTimer(FrameStats *stats)
+{
+    if (stats->inFrame)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+}
 
-void RenderScene(MyGeometry *geometry, MyShader *shader, GLuint renderMode)
+void CountDrawnVertices(FrameStats *stats, long long vertices)
 {
-    // clear screen to a dark grey colour
-    glClearColor(0.2, 0.2, 0.2, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
+    stats->current.verticesDrawn += vertices;
+}
 
-    // bind our shader program and the vertex array object containing our
-    // scene geometry, then tell OpenGL to draw our geometry
-    glUseProgram(shader->program);
-    glBindVertexArray(geometry->vertexArray);
-    glDrawArrays(renderMode, 0, geometry->elementCount);
+// Called after the buffer swap, charges the frame with the counters added since the previous one
+void EndFrameStats(FrameStats *stats)
+{
+    FrameRecord *record = &stats->current;
+    record->cpuMilliseconds = (glfwGetTime() - record->time) * 1000.0;
+    long long totals[COUNTER_TOTALS] = { counters.generateNanoseconds, counters.uploadNanoseconds,
+        counters.setupNanoseconds, counters.verticesGenerated, counters.bytesUploaded, counters.buffersAllocated,
+        counters.buffersFreed, counters.adaptiveSpiralVertices, counters.fixedStepSpiralVertices };
+    long long change[COUNTER_TOTALS];
+    for (int i = 0; i < COUNTER_TOTALS; i++)
+    {
+        change[i] = totals[i] - stats->totals[i];
+        stats->totals[i] = totals[i];
+    }
+    record->generateMilliseconds = change[0] * 1.0e-6;
+    record->uploadMilliseconds = change[1] * 1.0e-6;
+    record->setupMilliseconds = change[2] * 1.0e-6;
+    record->verticesGenerated = change[3];
+    record->bytesUploaded = change[4];
+    record->buffersAllocated = change[5];
+    record->buffersFreed = change[6];
+    record->adaptiveSpiralVertices = change[7];
+    record->fixedStepSpiralVertices = change[8];
 
-    // reset state to default (no shader or geometry bound)
-    glBindVertexArray(0);
-    glUseProgram(0);
+    int set = stats->frames % TIMER_FRAMES;
+    stats->window[stats->frames % STATS_WINDOW] = *record;
+    stats->queryFrame[set] = stats->frames;
+    stats->pending[set] = true;
+    stats->inFrame = false;
+    stats->frames++;
+}
 
-    // check for an report any OpenGL errors
-    CheckGLErrors();
+// Waits for the GPU times of the frames still in flight, so that their rows are complete
+void FlushFrameStats(FrameStats *stats)
+{
+    for (int i = 0; i < TIMER_FRAMES; i++)
+    {
+        ResolveFrameTimers(stats, (stats->frames + i) % TIMER_FRAMES, true);
+    }
 }
 
-// -------------------------------------------------------------------------
-// Spiral functions
+// Starts writing a CSV row for every frame from now on, returning false if the file cannot be created
+bool StartFrameTrace(FrameStats *stats)
+{
+    FlushFrameStats(stats);
+    stats->trace.open(stats->traceFilename.c_str());
+    if (!stats->trace)
+    {
+        cout << "Could not write the frame trace to " << stats->traceFilename << endl;
+        return false;
+    }
+    stats->trace << "frame,time,cpu_ms,gpu_clear_ms,gpu_draw_ms,generate_ms,upload_ms,setup_ms,"
+                 << "vertices_generated,vertices_drawn,bytes_uploaded,buffers_allocated,buffers_freed,"
+                 << "adaptive_spiral_vertices,fixed_step_spiral_vertices\n";
+    return true;
+}
 
-// Creation of the vectors that contains the geometry and the colour data, then binds it to the buffer
-bool InitializeSpirals(MyGeometry *geometry)
+void StopFrameTrace(FrameStats *stats)
 {
-    const GLuint VERTEX_INDEX = 0;
-    const GLuint COLOUR_INDEX = 1;
-    vector<GLfloat> vertices;
-    vector<GLfloat> colours;
-    int verticesCounter = 0;
+    FlushFrameStats(stats);
+    stats->trace.close();
+}
 
-    // Fill vectors with the geometry data for the spiral
-    float radius = 1.0f;
-    for (int i = 0; i < LEVEL; i++)
+// Prints the mean and the worst of the frames in the rolling window, with the sums of their counters
+void PrintFrameStats(FrameStats *stats)
+{
+    int frames = (int)min((unsigned long)STATS_WINDOW, stats->frames);
+    if (frames == 0)
     {
-        float numberSegments = 400.0 * LEVEL;
-        for (float j = 0.0f; j < numberSegments; j+=0.25f)
-        {
-            // the calculation for the x and y coordinates was based on: http://stackoverflow.com/a/18893438
-            float theta = ((LEVEL-0.5) * 2.0 * PI * j )/ numberSegments;
-            float x1 = -(radius/numberSegments) * j * cosf(theta);
-            float y1 = (radius/numberSegments) * j * sinf(theta);
-            float x2 = x1 - 0.01f * cosf(theta);
-            float y2 = y1 + 0.01f * sinf(theta);
-            vertices.push_back(x1);
-            vertices.push_back(y1);
-            vertices.push_back(x2);
-            vertices.push_back(y2);
-            verticesCounter+=2;
-        }
+        return;
     }
-
-    // Number of vertices in current level
-    geometry->elementCount = vertices.size() / 2;
-    glGenBuffers(1, &geometry->vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-    // Fill buffer array with the colour data for the spiral
-    GLfloat red = 1.0f;
-    GLfloat green = 1.0f;
-    GLfloat blue = 1.0f;
-    
-    int modifyColour = 1;
-    float direction = -1.0f;
-    float step = (3.5f*LEVEL)/verticesCounter;
-    for (int i = 0; i <=verticesCounter; i++)
-    {   
-        if (modifyColour == 1)
-        {
-            red = red + direction * step;
-            if (red > 1.0f)
-            {
-                modifyColour = 2;
-                red = 1.0f;
-            }
-            else if (red < 0.0f) {
-                modifyColour = 2;
-                red = 0.0f;
-            }
-        }
-        else if (modifyColour == 2)
+    double cpuTotal = 0.0, cpuLongest = 0.0;
+    double gpuTotal[GPU_PHASES] = { 0.0, 0.0 }, gpuLongest[GPU_PHASES] = { 0.0, 0.0 };
+    int gpuFrames[GPU_PHASES] = { 0, 0 };
+    FrameRecord sum;
+    for (int i = 0; i < frames; i++)
+    {
+        const FrameRecord &record = stats->window[i];
+        cpuTotal += record.cpuMilliseconds;
+        cpuLongest = max(cpuLongest, record.cpuMilliseconds);
+        for (int phase = 0; phase < GPU_PHASES; phase++)
         {
-            green = green + direction * step;
-            if (green > 1.0f)
+            if (record.gpuMilliseconds[phase] >= 0.0)
             {
-                modifyColour = 3;
-                green = 1.0f;
-            }
-            else if (green < 0.0f) {
-                modifyColour = 3;
-                green = 0.0f;
+                gpuTotal[phase] += record.gpuMilliseconds[phase];
+                gpuLongest[phase] = max(gpuLongest[phase], record.gpuMilliseconds[phase]);
+                gpuFrames[phase]++;
             }
         }
-        else if (modifyColour == 3)
+        sum.generateMilliseconds += record.generateMilliseconds;
+        sum.uploadMilliseconds += record.uploadMilliseconds;
+        sum.setupMilliseconds += record.setupMilliseconds;
+        sum.verticesGenerated += record.verticesGenerated;
+        sum.verticesDrawn += record.verticesDrawn;
+        sum.bytesUploaded += record.bytesUploaded;
+        sum.buffersAllocated += record.buffersAllocated;
+        sum.buffersFreed += record.buffersFreed;
+    }
+    cout << "Last " << frames << " frames: CPU mean " << cpuTotal / frames << " ms, longest " << cpuLongest << " ms";
+    const char *names[GPU_PHASES] = { "clear", "draw" };
+    for (int phase = 0; phase < GPU_PHASES; phase++)
+    {
+        if (gpuFrames[phase] > 0)
         {
-            blue = blue + direction * step;
-            if (blue > 1.0f)
-            {
-                modifyColour = 1;
-                blue = 1.0f;
-                direction = direction * -1.0f;
-            }
-            else if (blue < 0.0f) {
-                modifyColour = 1;
-                blue = 0.0f;
-                direction = direction * -1.0f;
-            }
+            cout << "; GPU " << names[phase] << " mean " << gpuTotal[phase] / gpuFrames[phase] << " ms, longest "
+                 << gpuLongest[phase] << " ms";
         }
-        colours.push_back(red);
-        colours.push_back(green);
-        colours.push_back(blue);
     }
-    
-    // create another one for storing our colours
-    glGenBuffers(1, &geometry->colourBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glBufferData(GL_ARRAY_BUFFER, colours.size() * sizeof(float), colours.data(), GL_STATIC_DRAW);
-
-    // create a vertex array object encapsulating all our vertex attributes
-    glGenVertexArrays(1, &geometry->vertexArray);
-    glBindVertexArray(geometry->vertexArray);
-
-    // associate the position array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glVertexAttribPointer(VERTEX_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(VERTEX_INDEX);
-
-    // associate the colour array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glVertexAttribPointer(COLOUR_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(COLOUR_INDEX);
-    // unbind our buffers, resetting to default state
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    // check for OpenGL errors and return false if error occurred
-    return !CheckGLErrors();
+    cout << endl;
+    cout << "  generating " << sum.generateMilliseconds << " ms, uploading " << sum.uploadMilliseconds
+         << " ms, vertex arrays " << sum.setupMilliseconds << " ms; " << sum.verticesGenerated
+         << " vertices generated, " << sum.verticesDrawn / frames << " drawn per frame, " << sum.bytesUploaded
+         << " bytes uploaded, " << sum.buffersAllocated << " buffers allocated and " << sum.buffersFreed
+         << " freed; " << stats->lateTimers << " GPU timers read too late since startup" << endl;
+    if (counters.fixedStepSpiralVertices > 0)
+    {
+        cout << "  adaptive spirals since startup: " << counters.adaptiveSpiralVertices << " vertices instead of "
+             << counters.fixedStepSpiralVertices << " with the fixed step" << endl;
+    }
 }
 
-// ----------------------------------------------------------------------------------
-// Functions related to the Sierpinski Triangle
-
-
-// Calculations of the coordinates of the triangles within an iteration
-void renderTriangleLevel(vector<GLfloat> *vertices, float x1, float y1, float x2, float y2, float x3, float y3, int level, int maxLevel)
+void DestroyFrameStats(FrameStats *stats)
 {
-    // Inverted triangle coordinates
-    float x1Inv = (x1+x2)/2.0f;
-    float y1Inv = (y2+y1)/2.0f;
-    float x2Inv = (x3+x2)/2.0f;
-    float y2Inv = (y3+y2)/2.0f;
-    float x3Inv = (x3+x1)/2.0f;
-    float y3Inv = (y3+y1)/2.0f;
-
-    // Inverted white triangle
-    vertices->push_back(x1Inv);
-    vertices->push_back(y1Inv);
-    vertices->push_back(x2Inv);
-    vertices->push_back(y2Inv);
-    vertices->push_back(x3Inv);
-    vertices->push_back(y3Inv);
-
-    // First triangle left bottom
-    vertices->push_back(x1);
-    vertices->push_back(y1);
-    vertices->push_back(x1Inv);
-    vertices->push_back(y1Inv);
-    vertices->push_back(x3Inv);
-    vertices->push_back(y3Inv);
-
-    // Second triangle right bottom
-    vertices->push_back(x1Inv);
-    vertices->push_back(y1Inv);
-    vertices->push_back(x2);
-    vertices->push_back(y2);
-    vertices->push_back(x2Inv);
-    vertices->push_back(y2Inv);
-
-    // Third triangle on top
-    vertices->push_back(x3Inv);
-    vertices->push_back(y3Inv);
-    vertices->push_back(x2Inv);
-    vertices->push_back(y2Inv);
-    vertices->push_back(x3);
-    vertices->push_back(y3);
-
-    if (level < maxLevel)
-    {   
-        level++;
-        renderTriangleLevel(vertices, x1, y1, x1Inv, y1Inv, x3Inv, y3Inv, level, maxLevel);
-        renderTriangleLevel(vertices, x1Inv, y1Inv, x2, y2, x2Inv, y2Inv, level, maxLevel);
-        renderTriangleLevel(vertices, x3, y3, x2Inv, y2Inv, x3Inv, y3Inv, level, maxLevel);
+    if (stats->trace.is_open())
+    {
+        StopFrameTrace(stats);
     }
+    glDeleteQueries(TIMER_FRAMES * GPU_PHASES, &stats->queries[0][0]);
 }
 
-// Assigning colour to each level recursively
-void coloursForLevelSierpinski(vector<GLfloat>* colours, GLfloat red, GLfloat green, GLfloat blue, int level, int maxLevel)
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL buffers for storing geometry data
+
+// Creates an array buffer object holding the given data and leaves it bound, counting its bytes
+// and the time taken to upload them for the geometry
+void UploadBuffer(MyGeometry *geometry, GLuint *buffer, GLsizeiptr bytes, const void *data)
 {
+    double start = glfwGetTime();
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+    geometry->bufferBytes += bytes;
+    geometry->uploadSeconds += glfwGetTime() - start;
+    AddSeconds(&counters.uploadNanoseconds, glfwGetTime() - start);
+    counters.bytesUploaded += bytes;
+    counters.buffersAllocated++;
+}
 
-    for (int j = 0; j < 3; j++)
+// Describes a vertex format and how many bytes each vertex takes in it
+const char *VertexFormatName(int format)
+{
+    if (format == 2)
     {
-        colours->push_back(red);
-        colours->push_back(green);
-        colours->push_back(blue);
+        return "interleaved half float positions and RGBA8 colours, 8 bytes per vertex";
     }
-    if (level < maxLevel)
+    else if (format == 3)
     {
-        level++;
-        GLfloat newRed = red + 0.1f;
-        GLfloat newGreen = green + 0.05f;
-        GLfloat newBlue = blue + 0.05f;
-        coloursForLevelSierpinski(colours, newRed, newGreen, newBlue, level, maxLevel);
-        coloursForLevelSierpinski(colours, newRed, newGreen, newBlue, level, maxLevel);
-        coloursForLevelSierpinski(colours, newRed, newGreen, newBlue, level, maxLevel);
-
+        return "interleaved 16 bit normalized positions and RGBA8 colours, 8 bytes per vertex";
+    }
+    else if (format == 4)
+    {
+        return "float positions with colours from the palette shader, 8 bytes per vertex";
     }
+    return "separate float position and colour buffers, 20 bytes per vertex";
 }
 
-
-void fillOneTriangleColour(vector<GLfloat> *colours, float red, float green, float blue)
+// Creates an array buffer object of the given size and maps it for writing, leaving it bound. A new
+// buffer has nothing drawing from it, so the driver neither waits nor keeps its old contents. Returns
+// null, without a buffer, if it could not be mapped
+void *MapNewBuffer(MyGeometry *geometry, GLuint *buffer, GLsizeiptr bytes)
 {
-    for (int j = 0; j < 3; j++)
+    double start = glfwGetTime();
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+    glBufferData(GL_ARRAY_BUFFER, bytes, 0, GL_STATIC_DRAW);
+    void *memory = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (memory == 0)
     {
-        colours->push_back(red);
-        colours->push_back(green);
-        colours->push_back(blue);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, buffer);
+        *buffer = 0;
+        return 0;
     }
+    geometry->bufferBytes += bytes;
+    geometry->uploadSeconds += glfwGetTime() - start;
+    AddSeconds(&counters.uploadNanoseconds, glfwGetTime() - start);
+    counters.bytesUploaded += bytes;
+    counters.buffersAllocated++;
+    return memory;
 }
-// Initial base triangle before the first iteration
-void assignColoursToLevelSierpinski(vector<GLfloat> *colours, int level, int maxLevel, int totalElements)
-{
-    int coloursAdded = 0;
-    float factor = 1.0f / (maxLevel * 72.0f);
-    // Red triangle
-    float redR = 0.9f;
-    float redG = 0.0f;
-    float redB = 0.3f;
-
-    // Cyan triangle
-    float greenR = 0.0f;
-    float greenG = 0.7f;
-    float greenB = 0.5f;
 
-    // Blue triangle
-    float blueR = 0.5f;
-    float blueG = 0.0f;
-    float blueB = 1.0f;
+// Unmaps a buffer written through MapNewBuffer, returning false if its contents were lost meanwhile
+bool UnmapBuffer(MyGeometry *geometry, GLuint buffer)
+{
+    double start = glfwGetTime();
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    bool intact = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    geometry->uploadSeconds += glfwGetTime() - start;
+    AddSeconds(&counters.uploadNanoseconds, glfwGetTime() - start);
+    return intact;
+}
 
-    int iterateUntil = 0;
-    switch(maxLevel){
-        case 1:
-            iterateUntil = 1;
-            break;
-        case 2:
-            iterateUntil = 4;
-            break;
-        case 3:
-            iterateUntil = 13;
-            break;
-        case 4:
-            iterateUntil = 40;
-            break;
-        case 5:
-            iterateUntil = 121;
-            break;
-        case 6:
-            iterateUntil = 364;
-            break;
+// Returns memory for the positions of count vertices: the mapped vertex buffer in the float formats,
+// or the vertex vector of the data otherwise or if mapping failed
+GLfloat *SinkVertices(GeometrySink *sink, GLsizei count)
+{
+    GeometryData *data = sink->data;
+    data->vertexCount = count;
+    if (sink->geometry != 0 && (sink->format == 1 || sink->format == 4))
+    {
+        void *mapped = MapNewBuffer(sink->geometry, &sink->geometry->vertexBuffer, count * 2 * sizeof(GLfloat));
+        if (mapped != 0)
+        {
+            return (GLfloat *)mapped;
+        }
+    }
+    data->vertexArray.resize(count * 2);
+    data->vertices = data->vertexArray.data();
+    return data->vertexArray.data();
+}
 
+// Returns memory for the colours of the vertices, like SinkVertices, or null in the palette format
+// where the vertex shader computes them
+GLfloat *SinkColours(GeometrySink *sink, GLsizei count)
+{
+    GeometryData *data = sink->data;
+    if (sink->format == 4)
+    {
+        return 0;
     }
-    for (int i = 0; i < iterateUntil; i++)
+    if (sink->geometry != 0 && sink->format == 1)
     {
-        fillOneTriangleColour(colours, 1.0f, 1.0f, 1.0f); // White triangle
-        fillOneTriangleColour(colours, redR, redG, redB); // Red triangle
-        fillOneTriangleColour(colours, greenR, greenG, greenB); // Cyan triangle
-        fillOneTriangleColour(colours, blueR, blueG, blueB); // Blue triangle
-        coloursAdded=+4;
-
-        // Modify red triangles
-        redR = redR - pow(factor, 2);
-        redG = redG + factor;
-        redB = redB + (factor/2.0f);
-
-        // Modify Cyan triangles
-        greenR = greenR + factor;
-        greenG = greenR - (factor + 0.1 * pow(-1.0,i));
-        greenB = greenB + (factor/2.0f);
+        void *mapped = MapNewBuffer(sink->geometry, &sink->geometry->colourBuffer, count * 3 * sizeof(GLfloat));
+        if (mapped != 0)
+        {
+            return (GLfloat *)mapped;
+        }
+    }
+    data->colourArray.resize(count * 3);
+    data->colours = data->colourArray.data();
+    return data->colourArray.data();
+}
 
-        // Modify blue triangles
-        blueR = blueR + (factor + 0.1 * pow(-1.0,i));
-        blueG = blueG + factor;
-        blueB = blueG - factor/4.0f;
+// Returns memory for count Sierpinski instances, which are uploaded as they are in every vertex format
+SierpinskiInstance *SinkInstances(GeometrySink *sink, GLsizei count)
+{
+    GeometryData *data = sink->data;
+    data->instanceCount = count;
+    if (sink->geometry != 0)
+    {
+        void *mapped = MapNewBuffer(sink->geometry, &sink->geometry->instanceBuffer, count * sizeof(SierpinskiInstance));
+        if (mapped != 0)
+        {
+            return (SierpinskiInstance *)mapped;
+        }
     }
+    data->instanceArray.resize(count);
+    data->instances = data->instanceArray.data();
+    return data->instanceArray.data();
 }
 
-// Initialization of the Sierpinski Triangle
-bool InitializeSierpinksiTriangle(MyGeometry *geometry)
+// Returns memory for count indices into the vertices, which must have been requested first since they
+// decide whether 16 or 32 bit indices are needed. The bytes of each index are stored in indexBytes, for
+// the caller to write them in that width. Indices are uploaded as they are in every vertex format
+void *SinkIndices(GeometrySink *sink, GLsizei count, int *indexBytes)
 {
-    const GLuint VERTEX_INDEX = 0;
+    GeometryData *data = sink->data;
+    data->indexCount = count;
+    data->indexBytes = IndexBytes(data->vertexCount);
+    *indexBytes = data->indexBytes;
+    if (sink->geometry != 0)
+    {
+        void *mapped = MapNewBuffer(sink->geometry, &sink->geometry->elementBuffer, (GLsizeiptr)count * data->indexBytes);
+        if (mapped != 0)
+        {
+            return mapped;
+        }
+    }
+    data->indexArray.resize((size_t)count * data->indexBytes);
+    data->indices = data->indexArray.data();
+    return data->indexArray.data();
+}
+
+// Uploads the arrays of the data that are not in buffers yet. In the float format positions and colours
+// have a buffer each, in the palette format only the positions are uploaded, even from mesh files that
+// hold colours. In the packed formats they share one buffer, with the positions as half floats or 16 bit
+// normalized integers and the colours as normalized bytes, packed straight into the mapped buffer.
+// Returns false if the contents of that buffer were lost
+bool UploadGeometryData(MyGeometry *geometry, const GeometryData &data, int format)
+{
+    bool intact = true;
+    if (format == 1 || format == 4)
+    {
+        if (data.vertices != 0)
+        {
+            UploadBuffer(geometry, &geometry->vertexBuffer, data.vertexCount * 2 * sizeof(GLfloat), data.vertices);
+        }
+        if (data.colours != 0 && format == 1)
+        {
+            UploadBuffer(geometry, &geometry->colourBuffer, data.vertexCount * 3 * sizeof(GLfloat), data.colours);
+        }
+    }
+    else if (data.vertices != 0)
+    {
+        // four bytes of position followed by four bytes of colour for every vertex
+        GLsizeiptr bytes = data.vertexCount * (data.colours != 0 ? 8 : 4);
+        GLubyte *packed = (GLubyte *)MapNewBuffer(geometry, &geometry->vertexBuffer, bytes);
+        if (packed != 0)
+        {
+            PackVertices(packed, data.vertices, data.colours, data.vertexCount, format == 2);
+            intact = UnmapBuffer(geometry, geometry->vertexBuffer);
+        }
+        else
+        {
+            vector<GLubyte> staging(bytes);
+            PackVertices(staging.data(), data.vertices, data.colours, data.vertexCount, format == 2);
+            UploadBuffer(geometry, &geometry->vertexBuffer, bytes, staging.data());
+        }
+    }
+    if (data.instances != 0)
+    {
+        UploadBuffer(geometry, &geometry->instanceBuffer, data.instanceCount * sizeof(SierpinskiInstance), data.instances);
+    }
+    if (data.indices != 0)
+    {
+        UploadBuffer(geometry, &geometry->elementBuffer, (GLsizeiptr)data.indexCount * data.indexBytes, data.indices);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return intact;
+}
+
+// Ends the writes of the Generate functions into the sink. Mapped buffers are unmapped and whatever had
+// to go through the vectors is uploaded, so that the data only keeps the counts. Returns false if the
+// contents of a mapped buffer were lost or the generation was cancelled
+bool FinishGeometry(GeometrySink *sink)
+{
+    MyGeometry *geometry = sink->geometry;
+    if (geometry == 0)
+    {
+        return !GeometryCancelled(sink->cancel);
+    }
+    bool intact = true;
+    GLuint buffers[] = { geometry->vertexBuffer, geometry->colourBuffer, geometry->instanceBuffer, geometry->elementBuffer };
+    for (int i = 0; i < 4; i++)
+    {
+        if (buffers[i] != 0 && !sink->computed)
+        {
+            intact = UnmapBuffer(geometry, buffers[i]) && intact;
+        }
+    }
+
+    // a cancelled shape was left half written, so its buffers are deleted instead of completed
+    GeometryData *data = sink->data;
+    if (GeometryCancelled(sink->cancel))
+    {
+        DestroyGeometry(geometry);
+        *geometry = MyGeometry();
+        intact = false;
+    }
+    else
+    {
+        intact = UploadGeometryData(geometry, *data, sink->format) && intact;
+    }
+    data->vertices = 0;
+    data->colours = 0;
+    data->instances = 0;
+    data->indices = 0;
+    vector<GLfloat>().swap(data->vertexArray);
+    vector<GLfloat>().swap(data->colourArray);
+    vector<SierpinskiInstance>().swap(data->instanceArray);
+    vector<GLubyte>().swap(data->indexArray);
+    return intact;
+}
+
+// Creates the vertex array object describing the uploaded vertices, in the vertex format of the
+// geometry, and their indices if there are any. Colours is false when the vertex shader computes them
+void SetupVertexArray(MyGeometry *geometry, bool colours)
+{
+    const GLuint VERTEX_INDEX = 0;
     const GLuint COLOUR_INDEX = 1;
-    vector<GLfloat> vertices;
-    vector<GLfloat> colours;
 
-    // Generate arrays with the vertex
+    // create a vertex array object encapsulating all our vertex attributes
+    glGenVertexArrays(1, &geometry->vertexArray);
+    glBindVertexArray(geometry->vertexArray);
+
+    if (geometry->format == 1 || geometry->format == 4)
+    {
+        // associate the position array with the vertex array object
+        glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+        glVertexAttribPointer(VERTEX_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(VERTEX_INDEX);
+
+        if (colours)
+        {
+            // associate the colour array with the vertex array object
+            glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
+            glVertexAttribPointer(COLOUR_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(COLOUR_INDEX);
+        }
+    }
+    else
+    {
+        // four bytes of position followed by four bytes of colour for every vertex
+        GLsizei stride = colours ? 8 : 4;
+
+        // associate both attributes of the interleaved buffer with the vertex array object
+        glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+        if (geometry->format == 2)
+        {
+            glVertexAttribPointer(VERTEX_INDEX, 2, GL_HALF_FLOAT, GL_FALSE, stride, 0);
+        }
+        else
+        {
+            glVertexAttribPointer(VERTEX_INDEX, 2, GL_SHORT, GL_TRUE, stride, 0);
+        }
+        glEnableVertexAttribArray(VERTEX_INDEX);
+        if (colours)
+        {
+            glVertexAttribPointer(COLOUR_INDEX, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)4);
+            glEnableVertexAttribArray(COLOUR_INDEX);
+        }
+    }
+
+    // the element buffer binding is part of the vertex array object
+    if (geometry->elementBuffer != 0)
+    {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->elementBuffer);
+    }
+
+    // unbind our buffers, resetting to default state
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// --------------------------------------------------------------------------
+// Functions to generate geometry with compute shaders
+
+// Compiles the compute programs and looks up the OpenGL 4.3 entry points, returning false if the
+// context does not have them
+bool InitializeComputeGeometry(ComputeGeometry *compute)
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    compute->dispatch = (DispatchComputeFunction)glfwGetProcAddress("glDispatchCompute");
+    compute->barrier = (MemoryBarrierFunction)glfwGetProcAddress("glMemoryBarrier");
+    if (major * 10 + minor < 43 || compute->dispatch == 0 || compute->barrier == 0)
+    {
+        return false;
+    }
+    return InitializeComputeShader(&compute->spiral, "compute_spiral.glsl")
+        && InitializeComputeShader(&compute->sierpinski, "compute_sierpinski.glsl");
+}
+
+// True if the shape going into the sink can be generated by a compute shader, which needs buffers in
+// the float vertex format that the sink creates itself
+bool ComputesGeometry(GeometrySink *sink)
+{
+    return computeGeometry.enabled && sink->geometry != 0 && sink->format == 1;
+}
+
+// Creates a buffer of the given size for a compute program to fill and binds it to the shader storage
+// block at binding. Nothing is uploaded, the buffer is only counted as allocated
+void CreateComputeBuffer(MyGeometry *geometry, GLuint *buffer, GLsizeiptr bytes, GLuint binding)
+{
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, 0, GL_STATIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, *buffer);
+    geometry->bufferBytes += bytes;
+    counters.buffersAllocated++;
+}
+
+// Runs the current compute program once per item and makes its writes visible to the vertex fetches and
+// buffer reads that follow. Other contexts see them once they waited on a fence placed after this
+void DispatchCompute(long long items)
+{
+    computeGeometry.dispatch((GLuint)((items + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE), 1, 1);
+    computeGeometry.barrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+// Generates the segments of the spiral, and their colours unless the vertex shader computes them, into
+// new buffers of the sink. Returns false, without touching the sink, if there are more samples than
+// one dispatch covers
+bool ComputeSpiral(GeometrySink *sink, int level, bool shaderColours)
+{
+    int samples = SpiralSampleCount(level);
+    if (samples > (long long)COMPUTE_MAX_GROUPS * COMPUTE_GROUP_SIZE)
+    {
+        return false;
+    }
+    float radiusStep, angleStep;
+    SpiralSteps(level, &radiusStep, &angleStep);
+    GLsizei vertices = samples * 2;
+    sink->data->vertexCount = vertices;
+    sink->computed = true;
+
+    lock_guard<mutex> guard(computeGeometry.lock);
+    MyGeometry *geometry = sink->geometry;
+    CreateComputeBuffer(geometry, &geometry->vertexBuffer, vertices * 2 * sizeof(GLfloat), 0);
+    if (!shaderColours)
+    {
+        CreateComputeBuffer(geometry, &geometry->colourBuffer, vertices * 3 * sizeof(GLfloat), 1);
+    }
+
+    // the colour ramp of FillSpiralColours()
+    GLuint program = computeGeometry.spiral.program;
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Samples"), samples);
+    glUniform1f(glGetUniformLocation(program, "RadiusStep"), radiusStep);
+    glUniform1f(glGetUniformLocation(program, "AngleStep"), angleStep);
+    glUniform1f(glGetUniformLocation(program, "SegmentLength"), SPIRAL_SEGMENT_LENGTH);
+    glUniform1i(glGetUniformLocation(program, "WriteColours"), !shaderColours);
+    glUniform1i(glGetUniformLocation(program, "HiddenVertices"), (level - 1) * vertices);
+    glUniform1f(glGetUniformLocation(program, "ColourStep"), 3.5f / vertices);
+    glUniform1i(glGetUniformLocation(program, "PhaseLength"), 2 * vertices / 7 + 1);
+    DispatchCompute(samples);
+    return true;
+}
+
+// Generates the groups subdivisions of the Sierpinski triangle with the given corners into new buffers
+// of the sink. The colours of the first subdivision of every run are replayed on the CPU and uploaded,
+// which is about 2% of the colour buffer
+void ComputeSierpinskiTriangle(GeometrySink *sink, long long groups, int level, const GLfloat *corners)
+{
+    long long runs = (groups + COMPUTE_SIERPINSKI_RUN - 1) / COMPUTE_SIERPINSKI_RUN;
+    vector<GLfloat> checkpoints(runs * SIERPINSKI_CHECKPOINT_FLOATS);
+    SierpinskiColourCheckpoints(checkpoints.data(), groups, level, COMPUTE_SIERPINSKI_RUN);
+    float factor;
+    double factorSquared;
+    SierpinskiColourFactors(level, &factor, &factorSquared);
+    GLsizei vertices = groups * SIERPINSKI_VERTEX_FLOATS / 2;
+    sink->data->vertexCount = vertices;
+    sink->computed = true;
+
+    lock_guard<mutex> guard(computeGeometry.lock);
+    MyGeometry *geometry = sink->geometry;
+    CreateComputeBuffer(geometry, &geometry->vertexBuffer, vertices * 2 * sizeof(GLfloat), 0);
+    CreateComputeBuffer(geometry, &geometry->colourBuffer, vertices * 3 * sizeof(GLfloat), 1);
+    MyGeometry staging;
+    GLuint checkpointBuffer;
+    CreateComputeBuffer(&staging, &checkpointBuffer, checkpoints.size() * sizeof(GLfloat), 2);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, checkpoints.size() * sizeof(GLfloat), checkpoints.data());
+    counters.bytesUploaded += checkpoints.size() * sizeof(GLfloat);
+
+    GLuint program = computeGeometry.sierpinski.program;
+    glUseProgram(program);
+    glUniform2fv(glGetUniformLocation(program, "BaseTriangle"), 3, corners);
+    glUniform1i(glGetUniformLocation(program, "Level"), level);
+    glUniform1i(glGetUniformLocation(program, "Groups"), (GLint)groups);
+    glUniform1i(glGetUniformLocation(program, "RunLength"), COMPUTE_SIERPINSKI_RUN);
+    glUniform1f(glGetUniformLocation(program, "Factor"), factor);
+    glUniform1d(glGetUniformLocation(program, "FactorSquared"), factorSquared);
+    DispatchCompute(runs);
+
+    // the deletion does not wait, OpenGL keeps the storage until the dispatch no longer uses it
+    glDeleteBuffers(1, &checkpointBuffer);
+    counters.buffersFreed++;
+}
+
+// -------------------------------------------------------------------------
+// Functions related to the Square and Diamond
+
+// Generate arrays with data for the levels after firstLevel up to level. Indexed, each corner is
+// generated once and the index buffer draws the same triangles from them
+void GenerateSquareAndDiamond(GeometrySink *sink, int firstLevel, int level, bool indexed)
+{
+    GLsizei count = SquareAndDiamondVertexCount(level) - SquareAndDiamondVertexCount(firstLevel);
+    if (indexed)
+    {
+        GLsizei corners = SquareAndDiamondIndexedVertexCount(level) - SquareAndDiamondIndexedVertexCount(firstLevel);
+        SetupVertexBufferSquareAndDiamond(firstLevel, level, SinkVertices(sink, corners), true);
+        SetupColourBufferSquareAndDiamond(firstLevel, level, SinkColours(sink, corners), true);
+        // the index size is only known once the indices are sunk
+        int indexBytes;
+        void *indices = SinkIndices(sink, count, &indexBytes);
+        SetupIndexBufferSquareAndDiamond(firstLevel, level, indices, indexBytes);
+        return;
+    }
+    SetupVertexBufferSquareAndDiamond(firstLevel, level, SinkVertices(sink, count), false);
+    GLfloat *colours = SinkColours(sink, count);
+    if (colours != 0)
+    {
+        SetupColourBufferSquareAndDiamond(firstLevel, level, colours, false);
+    }
+}
+
+// Describe the uploaded buffers, returning true if successful. In the palette format the colours come
+// from vertex_palette.glsl
+bool InitializeSquareAndDiamond(MyGeometry *geometry)
+{   
+    bool palette = geometry->format == 4;
+    if (palette)
+    {
+        geometry->program = paletteShader.program;
+        geometry->palette = 1;
+    }
+
+    // Placing the data into the buffers
+    SetupVertexArray(geometry, !palette);
+
+    // check for OpenGL errors and return false if error occurred
+    return !CheckGLErrors();
+}
+
+
+// Deallocate geometry-related objects
+void DestroyGeometry(MyGeometry *geometry)
+{
+    // unbind and destroy our vertex array object and associated buffers
+    glBindVertexArray(0);
+    GLuint buffers[] = { geometry->vertexBuffer, geometry->colourBuffer, geometry->instanceBuffer, geometry->elementBuffer };
+    counters.buffersFreed += 4 - count(buffers, buffers + 4, 0u);
+    glDeleteVertexArrays(1, &geometry->vertexArray);
+    glDeleteBuffers(1, &geometry->vertexBuffer);
+    glDeleteBuffers(1, &geometry->colourBuffer);
+    glDeleteBuffers(1, &geometry->instanceBuffer);
+    glDeleteBuffers(1, &geometry->elementBuffer);
+}
+
+// --------------------------------------------------------------------------
+// Rendering function that draws our scene to the frame buffer
+
+// Draws one geometry into the current viewport, without clearing it or checking for errors
+void DrawGeometry(MyGeometry *geometry, MyShader *shader, GLuint renderMode)
+{
+    // bind our shader program and the vertex array object containing our
+    // scene geometry, then tell OpenGL to draw our geometry
+    GLuint program = geometry->program != 0 ? geometry->program : shader->program;
+    glUseProgram(program);
+    if (geometry->level > 0)
+    {
+        glUniform1i(glGetUniformLocation(program, "Level"), geometry->level);
+    }
+    if (geometry->palette > 0)
+    {
+        glUniform1i(glGetUniformLocation(program, "Part"), geometry->palette);
+    }
+    glBindVertexArray(geometry->vertexArray);
+    if (geometry->instanceCount > 0)
+    {
+        glDrawArraysInstanced(renderMode, 0, geometry->elementCount, geometry->instanceCount);
+    }
+    else if (geometry->elementBuffer != 0)
+    {
+        glDrawElements(renderMode, geometry->elementCount, geometry->indexType, 0);
+    }
+    else
+    {
+        glDrawArrays(renderMode, 0, geometry->elementCount);
+    }
+
+    // reset state to default (no shader or geometry bound)
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void RenderScene(MyGeometry *geometry, MyShader *shader, GLuint renderMode)
+{
+    // clear screen to a dark grey colour
+    BeginGpuTimer(&frameStats, GPU_CLEAR);
+    glClearColor(0.2, 0.2, 0.2, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    EndGpuTimer(&frameStats);
+
+    // nothing to draw until the builder thread delivers the first shape
+    if (geometry->vertexArray == 0)
+    {
+        return;
+    }
+    BeginGpuTimer(&frameStats, GPU_DRAW);
+    DrawGeometry(geometry, shader, renderMode);
+    EndGpuTimer(&frameStats);
+    CountDrawnVertices(&frameStats, (long long)geometry->elementCount * max(geometry->instanceCount, 1));
+
+    // check for an report any OpenGL errors
+    CheckFrameErrors();
+}
+
+// Renders the scene the given number of times and returns the average seconds per frame
+double TimeFrames(MyGeometry *geometry, MyShader *shader, GLuint renderMode, int frames)
+{
+    glFinish();
+    double start = glfwGetTime();
+    for (int i = 0; i < frames; i++)
+    {
+        RenderScene(geometry, shader, renderMode);
+    }
+    glFinish();
+    return (glfwGetTime() - start) / frames;
+}
+
+// Renders the scene repeatedly and prints the average time per frame along
+// with the size of the geometry, to compare the different render paths
+void TimeScene(MyGeometry *geometry, MyShader *shader, GLuint renderMode)
+{
+    const int FRAMES = 100;
+    double elapsed = TimeFrames(geometry, shader, renderMode, FRAMES);
+#ifndef RELEASE
+    // the same frames once more with the other way of catching errors, to show what polling costs
+    pollFrameErrors = !pollFrameErrors;
+    double other = TimeFrames(geometry, shader, renderMode, FRAMES);
+    pollFrameErrors = !pollFrameErrors;
+    cout << "Frame time with glGetError after every frame: " << (pollFrameErrors ? elapsed : other) * 1000.0
+         << " ms, without: " << (pollFrameErrors ? other : elapsed) * 1000.0 << " ms" << endl;
+#endif
+    cout << "Frame time: " << elapsed * 1000.0 << " ms over " << FRAMES << " frames, "
+         << geometry->bufferBytes << " bytes uploaded";
+    if (geometry->instanceCount == 0 && geometry->vertexBuffer != 0)
+    {
+        cout << " as " << VertexFormatName(geometry->format);
+    }
+    cout << ", " << geometry->vertexCount << " vertices stored";
+    if (geometry->elementBuffer != 0)
+    {
+        cout << " and drawn with " << geometry->elementCount << (geometry->indexType == GL_UNSIGNED_SHORT ? " 16" : " 32")
+             << " bit indices";
+    }
+    cout << endl;
+}
+
+// -------------------------------------------------------------------------
+// Spiral functions
+
+// Creation of the geometry and the colour data. When the colours are computed in the vertex shader
+// only the geometry is generated
+void GenerateSpiral(GeometrySink *sink, int level, bool shaderColours)
+{
+    if (ComputesGeometry(sink) && ComputeSpiral(sink, level, shaderColours))
+    {
+        return;
+    }
+
+    // Fill the geometry data for the spiral, one segment per sample
+    GLsizei count = SpiralSampleCount(level) * 2;
+    EvaluateSpiral(SinkVertices(sink, count), level);
+
+    // Fill the colour data for the spiral
+    if (!shaderColours)
+    {
+        AssignSpiralColours(SinkColours(sink, count), level, sink->cancel);
+    }
+}
+
+// Creation of a spiral whose samples are spaced by arc length and curvature for the current framebuffer
+// size instead of the fixed step, so that it needs fewer vertices in small windows and keeps its
+// segments touching in large ones
+void GenerateAdaptiveSpiral(GeometrySink *sink, int level)
+{
+    int pixels = framebufferPixels;
+    vector<GLfloat> samples;
+    AdaptiveSpiralSamples(level, pixels * 0.5f, spiralSegmentPixels, &samples);
+    GLsizei count = samples.size() * 2;
+    EvaluateSpiralSamples(SinkVertices(sink, count), samples.data(), samples.size(), level);
+    AssignSpiralSampleColours(SinkColours(sink, count), samples.data(), samples.size(), level);
+    counters.adaptiveSpiralVertices += count;
+    counters.fixedStepSpiralVertices += SpiralSampleCount(level) * 2;
+}
+
+// Binds the geometry and colour buffers of the spiral to a vertex array. The palette format draws the
+// spiral with the colours of vertex_spiral.glsl, which already follow from the vertex index alone
+bool InitializeSpirals(MyGeometry *geometry, int level, bool shaderColours)
+{
+    if (shaderColours)
+    {
+        geometry->program = spiralShader.program;
+        geometry->level = level;
+    }
+
+    SetupVertexArray(geometry, !shaderColours);
+
+    // check for OpenGL errors and return false if error occurred
+    return !CheckGLErrors();
+}
+
+// ----------------------------------------------------------------------------------
+// Functions related to the Sierpinski Triangle
+
+// Generation of the Sierpinski Triangle, returning false if it does not fit in the memory limit. Indexed,
+// only the six corners of each subdivision are generated and drawn through an index buffer
+bool GenerateSierpinskiTriangle(GeometrySink *sink, int level, bool indexed)
+{
+    // Exact size of the geometric and colour data for every iteration
+    long long groups = SierpinskiGroupCount(level, indexed ? SIERPINSKI_INDEXED_BYTES_PER_GROUP : SIERPINSKI_BYTES_PER_GROUP);
+    if (groups < 0)
+    {
+        cout << "Sierpinski triangle with " << level << " iterations does not fit in the memory limit of "
+             << sierpinskiMemoryLimit << " bytes" << endl;
+        return false;
+    }
 
     // Base triangle vertices
     float x1 = -0.8f;
@@ -570,43 +1430,2526 @@ bool InitializeSierpinksiTriangle(MyGeometry *geometry)
     float y2 = -0.6f;
     float x3 =  0.0f;
     float y3 =  0.8f;
+    if (!indexed && ComputesGeometry(sink))
+    {
+        GLfloat corners[] = { x1, y1, x2, y2, x3, y3 };
+        ComputeSierpinskiTriangle(sink, groups, level, corners);
+        return true;
+    }
 
-    // First iteration for geometric and colour data
-    
-    renderTriangleLevel(&vertices, x1, y1, x2, y2, x3, y3, 1, LEVEL);
-    int totalVertices = vertices.size() / 2;
-    assignColoursToLevelSierpinski(&colours, 1, LEVEL, totalVertices);
+    // Every iteration for geometric and colour data
+    GLsizei count = groups * (indexed ? SIERPINSKI_INDEXED_VERTEX_FLOATS : SIERPINSKI_VERTEX_FLOATS) / 2;
+    GLfloat *vertices = SinkVertices(sink, count);
+    GLfloat *colours = SinkColours(sink, count);
+    GenerateSierpinski(vertices, colours, 0, x1, y1, x2, y2, x3, y3, level, indexed, sink->cancel);
+    if (indexed)
+    {
+        int indexBytes;
+        void *indices = SinkIndices(sink, groups * SIERPINSKI_INDICES, &indexBytes);
+        SetupIndexBufferSierpinski(groups, indices, indexBytes);
+    }
+    return true;
+}
 
-    // number of vertices in current level
-    geometry->elementCount = totalVertices;
-    // create an array buffer object for storing our vertices
-    glGenBuffers(1, &geometry->vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
-    // Generate buffer array for the colour
-    glGenBuffers(1, &geometry->colourBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glBufferData(GL_ARRAY_BUFFER, colours.size() * sizeof(GLfloat), colours.data(), GL_STATIC_DRAW);
+// Generation of the iterations after firstLevel up to level of the Sierpinski Triangle, to be drawn after
+// a triangle of firstLevel iterations. Each iteration only adds its own subdivisions, coloured as in a
+// triangle of that many iterations, which cover the last subdivisions of the iteration before. Returns
+// false if the whole triangle does not fit in the memory limit
+bool GenerateSierpinskiLevels(GeometrySink *sink, int firstLevel, int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP);
+    if (groups < 0)
+    {
+        cout << "Sierpinski triangle with " << level << " iterations does not fit in the memory limit of "
+             << sierpinskiMemoryLimit << " bytes" << endl;
+        return false;
+    }
+    GLsizei count = (groups - SierpinskiGroupCount(firstLevel, 0)) * SIERPINSKI_VERTEX_FLOATS / 2;
+    GLfloat *vertices = SinkVertices(sink, count);
+    GLfloat *colours = SinkColours(sink, count);
 
-    // create a vertex array object encapsulating all our vertex attributes
-    glGenVertexArrays(1, &geometry->vertexArray);
-    glBindVertexArray(geometry->vertexArray);
+    // iteration n subdivides 3^(n - 1) triangles
+    long long subdivisions = 1;
+    for (int n = 1; n <= firstLevel; n++)
+    {
+        subdivisions *= 3;
+    }
+    for (int n = firstLevel + 1; n <= level && !GeometryCancelled(sink->cancel); n++)
+    {
+        GenerateSierpinskiLeaves(vertices, colours, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, n, sink->cancel);
+        vertices += subdivisions * SIERPINSKI_VERTEX_FLOATS;
+        if (colours != 0)
+        {
+            colours += subdivisions * SIERPINSKI_COLOUR_FLOATS;
+        }
+        subdivisions *= 3;
+    }
+    return true;
+}
 
-    // associate the position array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-    glVertexAttribPointer(VERTEX_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(VERTEX_INDEX);
+// Generation of the Sierpinski Triangle as a cloud of points from the chaos game, four times as many
+// for every level, returning false if they do not fit in the memory limit. The points are written
+// straight into the buffers when they are mapped, on every core
+bool GenerateSierpinskiPoints(GeometrySink *sink, int level)
+{
+    long long points = ChaosGamePointCount(level, 5 * sizeof(GLfloat));
+    if (points < 0)
+    {
+        cout << "Sierpinski point cloud of level " << level << " does not fit in the memory limit of "
+             << sierpinskiMemoryLimit << " bytes" << endl;
+        return false;
+    }
+    GLfloat *vertices = SinkVertices(sink, points);
+    GLfloat *colours = SinkColours(sink, points);
+    GenerateChaosGame(vertices, colours, points, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, max(1u, thread::hardware_concurrency()), sink->cancel);
+    return true;
+}
+
+// Initialization of the Sierpinski Triangle. The corners shared by the triangles of a subdivision
+// drawn indexed only hold the colour of the triangle that lists them last, so those are shaded flat.
+// In the palette format the colours come from vertex_palette.glsl, which needs the level to find the
+// iterations appended to the triangle later
+bool InitializeSierpinksiTriangle(MyGeometry *geometry, int level, bool indexed)
+{
+    bool palette = geometry->format == 4;
+    if (indexed)
+    {
+        geometry->program = flatShader.program;
+    }
+    else if (palette)
+    {
+        if (!ExtendPaletteCheckpoints(level))
+        {
+            return false;
+        }
+        geometry->program = paletteShader.program;
+        geometry->palette = 3;
+        geometry->level = level;
+    }
+    SetupVertexArray(geometry, !palette);
 
-    // associate the colour array with the vertex array object
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->colourBuffer);
-    glVertexAttribPointer(COLOUR_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(COLOUR_INDEX);
-    // unbind our buffers, resetting to default state
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
     // check for OpenGL errors and return false if error occurred
+    return !CheckGLErrors();
+}
+
+// Generation of the placement and colours of every subdivision of the Sierpinski Triangle, returning
+// false if they do not fit in the memory limit
+bool GenerateSierpinskiInstances(GeometrySink *sink, int level)
+{
+    long long groups = SierpinskiGroupCount(level, sizeof(SierpinskiInstance));
+    if (groups < 0)
+    {
+        cout << "Sierpinski triangle with " << level << " iterations does not fit in the memory limit of "
+             << sierpinskiMemoryLimit << " bytes" << endl;
+        return false;
+    }
+    GenerateSierpinski(0, 0, SinkInstances(sink, groups), -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, level, false, sink->cancel);
+    return true;
+}
+
+// Initialization of the Sierpinski Triangle drawn as instances of one subdivided triangle, each
+// instance places and colours a single subdivision instead of storing its four triangles
+bool InitializeSierpinskiInstanced(MyGeometry *geometry)
+{
+    const GLuint VERTEX_INDEX = 0;
+    const GLuint OFFSET_INDEX = 2;
+    const GLuint SCALE_INDEX = 3;
+    const GLuint RED_INDEX = 4;
+    const GLuint CYAN_INDEX = 5;
+    const GLuint BLUE_INDEX = 6;
+
+    // Base triangle vertices
+    float x1 = -0.8f;
+    float y1 = -0.6f;
+    float x2 =  0.8f;
+    float y2 = -0.6f;
+    float x3 =  0.0f;
+    float y3 =  0.8f;
+
+    // One subdivision of the base triangle moved so that its left bottom corner is at the origin,
+    // every instance scales it and moves it to the left bottom corner of its own triangle. The
+    // second pair of coordinates lists the same subdivision starting from the top corner
+    GLfloat upright[SIERPINSKI_VERTEX_FLOATS];
+    GLfloat fromTop[SIERPINSKI_VERTEX_FLOATS];
+    renderTriangleLevel(upright, 0, 0.0f, 0.0f, x2 - x1, y2 - y1, x3 - x1, y3 - y1, 1, 1, false, 0);
+    renderTriangleLevel(fromTop, 0, x3 - x1, y3 - y1, x2 - x1, y2 - y1, 0.0f, 0.0f, 1, 1, false, 0);
+    GLfloat unitTriangle[2 * SIERPINSKI_VERTEX_FLOATS];
+    for (int i = 0; i < SIERPINSKI_VERTEX_FLOATS / 2; i++)
+    {
+        unitTriangle[4 * i] = upright[2 * i];
+        unitTriangle[4 * i + 1] = upright[2 * i + 1];
+        unitTriangle[4 * i + 2] = fromTop[2 * i];
+        unitTriangle[4 * i + 3] = fromTop[2 * i + 1];
+    }
+
+    // four triangles per instance, the instance buffer is already uploaded
+    geometry->elementCount = SIERPINSKI_VERTEX_FLOATS / 2;
+    geometry->program = instancedShader.program;
+    UploadBuffer(geometry, &geometry->vertexBuffer, sizeof(unitTriangle), unitTriangle);
+
+    // create a vertex array object encapsulating all our vertex attributes
+    glGenVertexArrays(1, &geometry->vertexArray);
+    glBindVertexArray(geometry->vertexArray);
+
+    // associate the unit triangle with the vertex array object
+    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+    glVertexAttribPointer(VERTEX_INDEX, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(VERTEX_INDEX);
+
+    // associate the instance array with the vertex array object, advancing once per instance
+    const GLsizei stride = sizeof(SierpinskiInstance);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry->instanceBuffer);
+    glVertexAttribPointer(OFFSET_INDEX, 2, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(SierpinskiInstance, offsetX));
+    glVertexAttribPointer(SCALE_INDEX, 1, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(SierpinskiInstance, scale));
+    glVertexAttribPointer(RED_INDEX, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(SierpinskiInstance, red));
+    glVertexAttribPointer(CYAN_INDEX, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(SierpinskiInstance, cyan));
+    glVertexAttribPointer(BLUE_INDEX, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)offsetof(SierpinskiInstance, blue));
+    GLuint instanceAttributes[] = { OFFSET_INDEX, SCALE_INDEX, RED_INDEX, CYAN_INDEX, BLUE_INDEX };
+    for (int i = 0; i < 5; i++)
+    {
+        glVertexAttribDivisor(instanceAttributes[i], 1);
+        glEnableVertexAttribArray(instanceAttributes[i]);
+    }
+    // unbind our buffers, resetting to default state
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    return !CheckGLErrors();
+}
+
+// Sets the uniforms of the program that generates the Sierpinski triangle from gl_VertexID, with the
+// same base triangle and starting colours as InitializeSierpinksiTriangle
+void SetupProceduralSierpinski(MyShader *shader)
+{
+    // Base triangle vertices
+    GLfloat baseTriangle[] = { -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f };
+
+    // Red, cyan and blue triangles of the first subdivision
+    GLfloat palette[] = {
+        0.9f, 0.0f, 0.3f,
+        0.0f, 0.7f, 0.5f,
+        0.5f, 0.0f, 1.0f
+    };
+
+    glUseProgram(shader->program);
+    glUniform2fv(glGetUniformLocation(shader->program, "BaseTriangle"), 3, baseTriangle);
+    glUniform3fv(glGetUniformLocation(shader->program, "Palette"), 3, palette);
+    glUniform1f(glGetUniformLocation(shader->program, "Alternate"), 0.1f);
+    glUseProgram(0);
+}
+
+// Levels of the Sierpinski triangle vertex_palette.glsl has drift factors for, more than fit in an int of vertices
+const int SIERPINSKI_PALETTE_LEVELS = 20;
+
+// The Palette uniform block of vertex_palette.glsl in the std140 layout, which pads every array element
+// to 16 bytes
+struct PaletteBlock
+{
+    GLfloat squareColour[4];
+    GLfloat diamondColour[4];
+    GLfloat levelStep;
+    GLfloat padding[3];
+    GLfloat sierpinskiFactor[SIERPINSKI_PALETTE_LEVELS][4];
+    GLdouble sierpinskiFactorSquared[SIERPINSKI_PALETTE_LEVELS][2];
+};
+
+// Fills the uniform buffer of the palette program with the start colours and steps the generators use,
+// and binds it to the Palette block. Also binds the texture of the Sierpinski colour checkpoints, which
+// ExtendPaletteCheckpoints() fills. Returns the uniform buffer
+GLuint SetupPalette(MyShader *shader)
+{
+    const GLuint PALETTE_BINDING = 0;
+    PaletteBlock palette;
+    memset(&palette, 0, sizeof(palette));
+    for (int c = 0; c < 3; c++)
+    {
+        palette.squareColour[c] = SQUARE_COLOUR[c];
+        palette.diamondColour[c] = DIAMOND_COLOUR[c];
+    }
+    palette.levelStep = SQUARE_AND_DIAMOND_STEP;
+    for (int level = 1; level <= SIERPINSKI_PALETTE_LEVELS; level++)
+    {
+        SierpinskiColourFactors(level, &palette.sierpinskiFactor[level - 1][0], &palette.sierpinskiFactorSquared[level - 1][0]);
+    }
+
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(palette), &palette, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, PALETTE_BINDING, buffer);
+    glUniformBlockBinding(shader->program, glGetUniformBlockIndex(shader->program, "Palette"), PALETTE_BINDING);
+
+    // a buffer only exists once it has been bound, the checkpoints are filled in as levels are set up
+    glGenBuffers(1, &paletteCheckpoints.buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteCheckpoints.buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &paletteCheckpoints.texture);
+    glActiveTexture(GL_TEXTURE0 + PALETTE_CHECKPOINT_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteCheckpoints.texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, paletteCheckpoints.buffer);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(shader->program);
+    glUniform1i(glGetUniformLocation(shader->program, "Checkpoints"), PALETTE_CHECKPOINT_UNIT);
+    glUniform1i(glGetUniformLocation(shader->program, "CheckpointInterval"), PALETTE_CHECKPOINT_INTERVAL);
+    glUseProgram(0);
+    return buffer;
+}
+
+// Makes sure the palette checkpoints cover the Sierpinski triangles of up to level iterations, so no
+// vertex replays more than PALETTE_CHECKPOINT_INTERVAL - 1 steps of the colour drift. Returns false,
+// leaving them as they were, if they would not fit in a texture buffer
+bool ExtendPaletteCheckpoints(int level)
+{
+    if (level <= paletteCheckpoints.levels)
+    {
+        return true;
+    }
+    long long floats = paletteCheckpoints.floats.size();
+    for (int n = paletteCheckpoints.levels + 1; n <= level; n++)
+    {
+        long long checkpointCount = (SierpinskiGroupCount(n, 0) + PALETTE_CHECKPOINT_INTERVAL - 1) / PALETTE_CHECKPOINT_INTERVAL;
+        floats += checkpointCount * SIERPINSKI_CHECKPOINT_FLOATS;
+    }
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (level > SIERPINSKI_PALETTE_LEVELS || floats > maxTexels)
+    {
+        cout << "Colours of a Sierpinski triangle with " << level << " iterations do not fit in a texture buffer" << endl;
+        return false;
+    }
+
+    double start = glfwGetTime();
+    for (int n = paletteCheckpoints.levels + 1; n <= level; n++)
+    {
+        long long groups = SierpinskiGroupCount(n, 0);
+        long long first = paletteCheckpoints.floats.size();
+        paletteCheckpoints.floats.resize(first + (groups + PALETTE_CHECKPOINT_INTERVAL - 1) / PALETTE_CHECKPOINT_INTERVAL * SIERPINSKI_CHECKPOINT_FLOATS);
+        SierpinskiColourCheckpoints(&paletteCheckpoints.floats[first], groups, n, PALETTE_CHECKPOINT_INTERVAL);
+    }
+    GLsizeiptr bytes = paletteCheckpoints.floats.size() * sizeof(GLfloat);
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteCheckpoints.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bytes, paletteCheckpoints.floats.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    counters.bytesUploaded += bytes;
+    AddSeconds(&counters.uploadNanoseconds, glfwGetTime() - start);
+    paletteCheckpoints.levels = level;
+    return !CheckGLErrors();
+}
+
+// Deletes the uniform buffer and checkpoints of the palette program
+void DestroyPalette()
+{
+    glDeleteBuffers(1, &paletteBuffer);
+    glDeleteBuffers(1, &paletteCheckpoints.buffer);
+    glDeleteTextures(1, &paletteCheckpoints.texture);
+    paletteCheckpoints = PaletteCheckpoints();
+}
+
+// Initialization of the Sierpinski Triangle generated in the vertex shader. Nothing is uploaded, the
+// vertex array only exists because the core profile needs one bound to draw
+bool InitializeSierpinskiProcedural(MyGeometry *geometry, int level)
+{
+    long long groups = SierpinskiGroupCount(level, 0);
+    if (groups < 0)
+    {
+        cout << "Sierpinski triangle with " << level << " iterations has too many vertices to draw" << endl;
+        return false;
+    }
+
+    geometry->elementCount = groups * SIERPINSKI_VERTEX_FLOATS / 2;
+    geometry->program = proceduralShader.program;
+    geometry->level = level;
+    glGenVertexArrays(1, &geometry->vertexArray);
+
+    return !CheckGLErrors();
+}
+
+// Describes how the Sierpinski triangle is drawn in the given mode
+const char *SierpinskiModeName(int mode)
+{
+    if (mode == 2)
+    {
+        return "instanced";
+    }
+    else if (mode == 3)
+    {
+        return "from gl_VertexID without vertex buffers";
+    }
+    else if (mode == 4)
+    {
+        return "from the corners of each subdivision through an index buffer";
+    }
+    else if (mode == 5)
+    {
+        return "as a cloud of points from the chaos game";
+    }
+    return "from one vertex array";
+}
+
+// --------------------------------------------------------------------------
+// Geometry cache functions
+
+// Render path currently selected for a part, shapes built for different paths are cached separately
+int GeometryVariant(int part)
+{
+    if (part == 1)
+    {
+        return SQUARE_MODE;
+    }
+    else if (part == 2)
+    {
+        return SPIRAL_MODE;
+    }
+    else if (part == 3)
+    {
+        return SIERPINSKI_MODE;
+    }
+    return 0;
+}
+
+// True if the render path draws its vertices from vertex arrays, which can be stored in any vertex format
+bool GeometryHasVertexArrays(int part, int variant)
+{
+    return part != 3 || variant == 1 || variant == 4 || variant == 5;
+}
+
+// True if the render path draws its vertices through an index buffer
+bool GeometryIndexed(int part, int variant)
+{
+    return (part == 1 && variant == 2) || (part == 3 && variant == 4);
+}
+
+// True if the render path can be drawn in the palette format: the square and diamond, the spiral and the
+// Sierpinski triangle drawn from vertex arrays in order, whose colours follow from the vertex index alone.
+// The other paths draw through indices or instances, have shaders of their own or space their vertices unevenly
+bool GeometryHasPalette(int part, int variant)
+{
+    return (part == 1 && variant == 1) || (part == 2 && variant == 1) || (part == 3 && variant == 1);
+}
+
+// Vertex format currently selected for a render path, only the paths drawn from vertex arrays can be packed
+// and only some of those have their colours computed by the palette shader
+int GeometryFormat(int part, int variant)
+{
+    if (!GeometryHasVertexArrays(part, variant) || (VERTEX_FORMAT == 4 && !GeometryHasPalette(part, variant)))
+    {
+        return 1;
+    }
+    return VERTEX_FORMAT;
+}
+
+// Framebuffer size a render path is sampled for, zero for the paths that look the same at any size
+int GeometryPixels(int part, int variant)
+{
+    return part == 2 && variant == 3 ? (int)framebufferPixels : 0;
+}
+
+// OpenGL primitive the vertices of a render path are drawn as
+GLuint GeometryDrawMode(int part, int variant)
+{
+    if (part == 3 && variant == 5)
+    {
+        return GL_POINTS;
+    }
+    return part == 2 ? GL_LINES : GL_TRIANGLES;
+}
+
+// True if the vertices of every level of the shape start with those of the levels below it, so that
+// a cached shape can be grown by appending levels and drawn at a lower level by drawing fewer vertices.
+// Indexed shapes are only drawn at lower levels, since their index size depends on the whole shape
+bool GeometryGrows(int part, int variant)
+{
+    return variant == 1 && (part == 1 || part == 3);
+}
+
+// Number of vertices drawn for a level of a shape that grows, which for the indexed square and
+// diamond is also the number of indices
+GLsizei GrowingVertexCount(int part, int level)
+{
+    if (part == 1)
+    {
+        return SquareAndDiamondVertexCount(level);
+    }
+    return SierpinskiGroupCount(level, 0) * SIERPINSKI_VERTEX_FLOATS / 2;
+}
+
+// Generates the arrays of the shape for the given part, level and render path into the sink. Without
+// mapped buffers this makes no OpenGL calls. Returns false if the shape is too large or its buffers
+// lost their contents
+bool GenerateGeometry(int part, int level, int variant, GeometrySink *sink)
+{
+    double start = glfwGetTime();
+    bool generated = true;
+    if (part == 1)
+    {
+        GenerateSquareAndDiamond(sink, 0, level, variant == 2);
+    }
+    else if (part == 2 && variant == 3)
+    {
+        GenerateAdaptiveSpiral(sink, level);
+    }
+    else if (part == 2)
+    {
+        GenerateSpiral(sink, level, variant == 2 || sink->format == 4);
+    }
+    else if (part == 3 && variant == 2)
+    {
+        generated = GenerateSierpinskiInstances(sink, level);
+    }
+    else if (part == 3 && (variant == 1 || variant == 4))
+    {
+        generated = GenerateSierpinskiTriangle(sink, level, variant == 4);
+    }
+    else if (part == 3 && variant == 5)
+    {
+        generated = GenerateSierpinskiPoints(sink, level);
+    }
+    AddSeconds(&counters.generateNanoseconds, glfwGetTime() - start);
+    counters.verticesGenerated += sink->data->vertexCount;
+    return FinishGeometry(sink) && generated;
+}
+
+// Generates only the levels after firstLevel up to level of a shape that grows into the sink, to be
+// appended to the shape of firstLevel. Returns false like GenerateGeometry()
+bool GenerateGeometryLevels(int part, int firstLevel, int level, GeometrySink *sink)
+{
+    double start = glfwGetTime();
+    bool generated = true;
+    if (part == 1)
+    {
+        GenerateSquareAndDiamond(sink, firstLevel, level, false);
+    }
+    else
+    {
+        generated = GenerateSierpinskiLevels(sink, firstLevel, level);
+    }
+    AddSeconds(&counters.generateNanoseconds, glfwGetTime() - start);
+    counters.verticesGenerated += sink->data->vertexCount;
+    return FinishGeometry(sink) && generated;
+}
+
+// Uploads whatever arrays of a shape are not in the buffers of the geometry yet, in the given vertex
+// format, and creates the vertex array describing them
+bool InitializeGeometry(int part, int level, int variant, int format, const GeometryData &data,
+    MyGeometry *geometry, GLuint *mode)
+{
+    *mode = GeometryDrawMode(part, variant);
+    geometry->elementCount = data.indexCount > 0 ? data.indexCount : data.vertexCount;
+    geometry->vertexCount = data.vertexCount;
+    geometry->indexType = data.indexCount == 0 ? 0 : (data.indexBytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+    geometry->instanceCount = data.instanceCount;
+    geometry->format = format;
+    if (!UploadGeometryData(geometry, data, format))
+    {
+        cout << "Program lost the contents of a mapped buffer!" << endl;
+        return false;
+    }
+    double start = glfwGetTime();
+    if (part == 1)
+    {
+        if (!InitializeSquareAndDiamond(geometry))
+        {
+            cout << "Program failed to intialize geometry!" << endl;
+            return false;
+        }
+    }
+    else if (part == 2) {
+        if (!InitializeSpirals(geometry, level, variant == 2 || format == 4))
+        {
+            cout << "Program failed to intialize spirals!" << endl;
+            return false;
+        }
+    }
+    else if (part == 3) {
+        bool initialized;
+        if (variant == 2)
+        {
+            initialized = InitializeSierpinskiInstanced(geometry);
+        }
+        else if (variant == 3)
+        {
+            initialized = InitializeSierpinskiProcedural(geometry, level);
+        }
+        else
+        {
+            initialized = InitializeSierpinksiTriangle(geometry, level, variant == 4);
+        }
+        if (!initialized)
+        {
+            cout << "Program failed to intialize sierpinski triangles!" << endl;
+            return false;
+        }
+    }
+    AddSeconds(&counters.setupNanoseconds, glfwGetTime() - start);
+    return true;
+}
+
+// Builds the shape for the given part, level, render path and vertex format into a new set of buffers
+bool BuildGeometry(int part, int level, int variant, int format, MyGeometry *geometry, GLuint *mode)
+{
+    GeometryData data;
+    GeometrySink sink(&data, mappedGeometrySink ? geometry : 0, format);
+    return GenerateGeometry(part, level, variant, &sink)
+        && InitializeGeometry(part, level, variant, format, data, geometry, mode);
+}
+
+// Points the arrays of data into the mapped mesh file of (part, level, variant), without reading
+// them. Returns false if there is no such file or it holds another shape
+bool MapMeshGeometry(int part, int level, int variant, MappedMeshFile *mesh, GeometryData *data)
+{
+    string filename = MeshFileName(meshDirectory, part, level, variant);
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0)
+    {
+        return false;
+    }
+    if (!MapMeshFile(filename, mesh))
+    {
+        cout << "Ignoring " << filename << ", it is not a mesh file of version " << MESH_FILE_VERSION << endl;
+        return false;
+    }
+
+    const MeshFileHeader *header = mesh->header;
+    bool instanced = part == 3 && variant == 2;
+    bool coloured = !instanced && !(part == 2 && variant == 2);
+    if (header->part != part || header->level != level || header->variant != variant
+        || header->drawMode != GeometryDrawMode(part, variant) || (header->instanceOffset != 0) != instanced
+        || (header->vertexOffset != 0) == instanced || (header->colourOffset != 0) != coloured)
+    {
+        cout << "Ignoring " << filename << ", it holds another shape" << endl;
+        UnmapMeshFile(mesh);
+        return false;
+    }
+    const char *file = (const char *)mesh->address;
+    data->vertices = header->vertexOffset != 0 ? (const GLfloat *)(file + header->vertexOffset) : 0;
+    data->colours = header->colourOffset != 0 ? (const GLfloat *)(file + header->colourOffset) : 0;
+    data->vertexCount = header->vertexCount;
+    data->instances = header->instanceOffset != 0 ? (const SierpinskiInstance *)(file + header->instanceOffset) : 0;
+    data->instanceCount = header->instanceCount;
+    return true;
+}
+
+// Writes every part up to maxLevel, in each render path that has arrays, into mesh files in the
+// directory. Returns false if a file could not be written
+bool PregenerateMeshes(const string &directory, int maxLevel)
+{
+    // the Sierpinski triangle generated in the vertex shader has nothing to store, and the indexed
+    // modes that come after it have no place for their indices in a mesh file
+    // the adaptive spiral depends on the window, so only the fixed step one is pregenerated
+    const int modes[] = { 1, 2, 2 };
+    mkdir(directory.c_str(), 0755);
+    bool succeeded = true;
+    int written = 0;
+    for (int part = 1; part <= NUMBER_OF_PARTS; part++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            for (int mode = 1; mode <= modes[part - 1]; mode++)
+            {
+                int variant = mode;
+                GeometryData data;
+                GeometrySink sink(&data, 0, 1);
+                if (!GenerateGeometry(part, level, variant, &sink))
+                {
+                    continue;
+                }
+                MeshFileHeader header = MeshFileHeader();
+                header.part = part;
+                header.level = level;
+                header.variant = variant;
+                header.drawMode = GeometryDrawMode(part, variant);
+                header.vertexCount = data.vertexCount;
+                header.instanceCount = data.instanceCount;
+                string filename = MeshFileName(directory, part, level, variant);
+                if (!WriteMeshFile(filename, &header, data.vertices, data.colours, data.instances))
+                {
+                    cout << "ERROR: could not write mesh file " << filename << endl;
+                    succeeded = false;
+                    continue;
+                }
+                written++;
+            }
+        }
+    }
+    cout << "Wrote " << written << " mesh files to " << directory << endl;
+    return succeeded;
+}
+
+// Returns the index of the resident entry drawing (part, level, variant, format), or -1 if it is not cached
+int FindCacheEntry(GeometryCache *cache, int part, int level, int variant, int format)
+{
+    for (size_t i = 0; i < cache->entries.size(); i++)
+    {
+        const CacheEntry &entry = cache->entries[i];
+        if (entry.part == part && entry.lowestLevel <= level && level <= entry.level
+            && entry.variant == variant && entry.format == format && entry.pixels == GeometryPixels(part, variant))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the index of the resident entry with the deepest level below level that can be grown to it,
+// or -1 if there is none
+int FindGrowableEntry(GeometryCache *cache, int part, int level, int variant, int format)
+{
+    int deepest = -1;
+    if (!GeometryGrows(part, variant))
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < cache->entries.size(); i++)
+    {
+        const CacheEntry &entry = cache->entries[i];
+        if (entry.part == part && entry.level < level && entry.variant == variant && entry.format == format
+            && (deepest < 0 || entry.level > cache->entries[deepest].level))
+        {
+            deepest = i;
+        }
+    }
+    return deepest;
+}
+
+// Evicts least recently used entries until the resident size fits the budget,
+// never evicting the entry at index keep (the one about to be displayed)
+void EvictGeometry(GeometryCache *cache, int keep)
+{
+    while (cache->residentBytes > cache->budgetBytes)
+    {
+        int oldest = -1;
+        for (size_t i = 0; i < cache->entries.size(); i++)
+        {
+            if ((int)i != keep && (oldest < 0 || cache->entries[i].lastUsed < cache->entries[oldest].lastUsed))
+            {
+                oldest = i;
+            }
+        }
+        if (oldest < 0)
+        {
+            return;
+        }
+        cache->residentBytes -= cache->entries[oldest].geometry.bufferBytes;
+        DestroyGeometry(&cache->entries[oldest].geometry);
+        cache->entries.erase(cache->entries.begin() + oldest);
+        cache->evictions++;
+        if (oldest < keep)
+        {
+            keep--;
+        }
+    }
+}
+
+// Releases the entries sampled for another framebuffer size, except the one on screen which is drawn
+// until its replacement is built
+void DropResizedGeometry(GeometryCache *cache, const MyGeometry &displayed)
+{
+    for (size_t i = 0; i < cache->entries.size(); )
+    {
+        CacheEntry &entry = cache->entries[i];
+        if (entry.pixels == GeometryPixels(entry.part, entry.variant) || entry.geometry.vertexArray == displayed.vertexArray)
+        {
+            i++;
+            continue;
+        }
+        cache->residentBytes -= entry.geometry.bufferBytes;
+        DestroyGeometry(&entry.geometry);
+        cache->entries.erase(cache->entries.begin() + i);
+        cache->evictions++;
+    }
+}
+
+// Uploads a newly generated shape into the cache, returning its index or -1 if the upload failed.
+// Buffers holds the arrays that were generated straight into mapped buffers, the cache takes them over
+int InsertGeometry(GeometryCache *cache, int part, int level, int variant, int format, const GeometryData &data,
+    const MyGeometry &buffers)
+{
+    CacheEntry entry;
+    entry.part = part;
+    entry.level = level;
+    // every level of the square and diamond is generated after the ones inside it, while the triangle
+    // is generated in depth first order and only starts with its lower levels once it was grown
+    entry.lowestLevel = part == 1 ? 1 : level;
+    entry.variant = variant;
+    entry.format = format;
+    entry.pixels = GeometryPixels(part, variant);
+    entry.geometry = buffers;
+    entry.lastUsed = 0;
+    if (!InitializeGeometry(part, level, variant, format, data, &entry.geometry, &entry.renderMode))
+    {
+        DestroyGeometry(&entry.geometry);
+        return -1;
+    }
+    cache->entries.push_back(entry);
+    cache->residentBytes += entry.geometry.bufferBytes;
+    return cache->entries.size() - 1;
+}
+
+// Copies the first bytes of buffer into a new buffer extraBytes larger, on the GPU, and returns the new one
+GLuint CopyIntoLargerBuffer(GLuint buffer, GLint64 bytes, GLint64 extraBytes)
+{
+    GLuint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, bytes + extraBytes, 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    counters.buffersAllocated++;
+    return grown;
+}
+
+// Appends levels generated by GenerateGeometryLevels() to the cached entry at index, which becomes the
+// shape of level. Its buffers are copied into larger ones on the GPU followed by the tail buffers
+// holding the new levels, so nothing already uploaded is generated or sent again. The tail buffers are
+// released either way. Returns false, leaving the entry as it was, if the new levels could not be uploaded
+bool GrowCacheEntry(GeometryCache *cache, int index, int level, const GeometryData &data, MyGeometry *tail)
+{
+    MyGeometry *geometry = &cache->entries[index].geometry;
+    if (geometry->palette == 3 && !ExtendPaletteCheckpoints(level))
+    {
+        DestroyGeometry(tail);
+        return false;
+    }
+    if (!UploadGeometryData(tail, data, geometry->format))
+    {
+        cout << "Program lost the contents of a mapped buffer!" << endl;
+        DestroyGeometry(tail);
+        return false;
+    }
+
+    double start = glfwGetTime();
+    GLuint *buffers[] = { &geometry->vertexBuffer, &geometry->colourBuffer };
+    GLuint tails[] = { tail->vertexBuffer, tail->colourBuffer };
+    for (int i = 0; i < 2; i++)
+    {
+        if (tails[i] == 0)
+        {
+            continue;
+        }
+        GLint64 bytes;
+        GLint64 tailBytes;
+        glBindBuffer(GL_COPY_READ_BUFFER, *buffers[i]);
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &bytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, tails[i]);
+        glGetBufferParameteri64v(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &tailBytes);
+
+        GLuint grown = CopyIntoLargerBuffer(*buffers[i], bytes, tailBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, tails[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, bytes, tailBytes);
+        glDeleteBuffers(1, buffers[i]);
+        *buffers[i] = grown;
+        counters.buffersFreed++;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // the vertex array still refers to the old buffers
+    glDeleteVertexArrays(1, &geometry->vertexArray);
+    SetupVertexArray(geometry, geometry->format != 4);
+
+    geometry->elementCount += data.vertexCount;
+    geometry->vertexCount += data.vertexCount;
+    geometry->bufferBytes += tail->bufferBytes;
+    geometry->uploadSeconds += tail->uploadSeconds + glfwGetTime() - start;
+    AddSeconds(&counters.uploadNanoseconds, glfwGetTime() - start);
+    cache->residentBytes += tail->bufferBytes;
+    cache->entries[index].level = level;
+    cache->levelSteps++;
+    DestroyGeometry(tail);
+    return !CheckGLErrors();
+}
+
+// True if a Sierpinski triangle can be grown up to level by vertex_subdivide.glsl: the whole triangle has
+// to fit in the memory limit, and the triangle of one level less and the colour checkpoints in texture
+// buffers. Lower levels need less of both
+bool SubdividesToLevel(int level)
+{
+    long long groups = SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP);
+    long long checkpointCount = (groups + SUBDIVISION_CHECKPOINT_INTERVAL - 1) / SUBDIVISION_CHECKPOINT_INTERVAL;
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    return groups >= 0 && SierpinskiGroupCount(level - 1, 0) * SIERPINSKI_VERTEX_FLOATS / 2 <= maxTexels
+        && checkpointCount * SIERPINSKI_CHECKPOINT_FLOATS <= maxTexels;
+}
+
+// Adds one iteration to the cached Sierpinski triangle at index in a single transform feedback pass of
+// vertex_subdivide.glsl, once SubdividesToLevel() allowed it. The buffers are copied into larger ones on
+// the GPU and the subdivisions of the new iteration are written after them, made from the last iteration
+// already there, so no vertex is generated or uploaded; only the colour checkpoints of the new iteration
+// are replayed on the CPU and uploaded. Returns false if OpenGL reported an error
+bool SubdivideCacheEntry(GeometryCache *cache, int index)
+{
+    CacheEntry *entry = &cache->entries[index];
+    MyGeometry *geometry = &entry->geometry;
+    int level = entry->level + 1;
+    long long groups = SierpinskiGroupCount(level, 0);
+    long long checkpointCount = (groups + SUBDIVISION_CHECKPOINT_INTERVAL - 1) / SUBDIVISION_CHECKPOINT_INTERVAL;
+
+    double start = glfwGetTime();
+    long long parentGroups = SierpinskiGroupCount(entry->level, 0);
+    long long parents = (2 * parentGroups + 1) / 3;     // subdivisions of the last iteration
+    GLsizei vertices = 3 * parents * SIERPINSKI_VERTEX_FLOATS / 2;
+    vector<GLfloat> checkpoints(checkpointCount * SIERPINSKI_CHECKPOINT_FLOATS);
+    SierpinskiColourCheckpoints(checkpoints.data(), groups, level, SUBDIVISION_CHECKPOINT_INTERVAL);
+    float factor;
+    double factorSquared;
+    SierpinskiColourFactors(level, &factor, &factorSquared);
+    GLsizeiptr checkpointBytes = checkpoints.size() * sizeof(GLfloat);
+
+    // the vertices so far and the checkpoints are read through texture buffers
+    GLuint checkpointBuffer;
+    glGenBuffers(1, &checkpointBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, checkpointBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, checkpointBytes, checkpoints.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    GLuint textures[2];
+    glGenTextures(2, textures);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[0]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, geometry->vertexBuffer);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[1]);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, checkpointBuffer);
+
+    GLint64 vertexBytes = (GLint64)geometry->vertexCount * 2 * sizeof(GLfloat);
+    GLint64 colourBytes = (GLint64)geometry->vertexCount * 3 * sizeof(GLfloat);
+    GLint64 tailVertexBytes = (GLint64)vertices * 2 * sizeof(GLfloat);
+    GLint64 tailColourBytes = (GLint64)vertices * 3 * sizeof(GLfloat);
+    GLuint grownVertices = CopyIntoLargerBuffer(geometry->vertexBuffer, vertexBytes, tailVertexBytes);
+    GLuint grownColours = CopyIntoLargerBuffer(geometry->colourBuffer, colourBytes, tailColourBytes);
+
+    // a triangle that was not grown yet holds its last iteration in depth first order among the others,
+    // a grown one holds it in the block appended last
+    GLuint program = subdivisionShader.program;
+    bool grown = entry->level > entry->lowestLevel;
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "Parents"), 0);
+    glUniform1i(glGetUniformLocation(program, "ParentFirst"), grown ? geometry->vertexCount - parents * 12 : 0);
+    glUniform1i(glGetUniformLocation(program, "ParentGroups"), grown ? 0 : (GLint)parentGroups);
+    glUniform1i(glGetUniformLocation(program, "Groups"), (GLint)groups);
+    glUniform1i(glGetUniformLocation(program, "Checkpoints"), 1);
+    glUniform1i(glGetUniformLocation(program, "CheckpointInterval"), SUBDIVISION_CHECKPOINT_INTERVAL);
+    glUniform1f(glGetUniformLocation(program, "Factor"), factor);
+    glUniform1d(glGetUniformLocation(program, "FactorSquared"), factorSquared);
+
+    // nothing is rasterized, the vertex array only exists because the core profile needs one bound to draw
+    GLuint vertexArray;
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, grownVertices, vertexBytes, tailVertexBytes);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, grownColours, colourBytes, tailColourBytes);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, vertices);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vertexArray);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glDeleteTextures(2, textures);
+    glDeleteBuffers(1, &checkpointBuffer);
+
+    glDeleteBuffers(1, &geometry->vertexBuffer);
+    glDeleteBuffers(1, &geometry->colourBuffer);
+    geometry->vertexBuffer = grownVertices;
+    geometry->colourBuffer = grownColours;
+    glDeleteVertexArrays(1, &geometry->vertexArray);
+    SetupVertexArray(geometry, true);
+    counters.buffersAllocated++;
+    counters.buffersFreed += 3;
+    counters.bytesUploaded += checkpointBytes;
+    counters.verticesGenerated += vertices;
+
+    geometry->elementCount += vertices;
+    geometry->vertexCount += vertices;
+    geometry->bufferBytes += tailVertexBytes + tailColourBytes;
+    AddSeconds(&counters.generateNanoseconds, glfwGetTime() - start);
+    cache->residentBytes += tailVertexBytes + tailColourBytes;
+    entry->level = level;
+    cache->levelSteps++;
+    return !CheckGLErrors();
+}
+
+// Grows the deepest cached Sierpinski triangle below level up to it with one transform feedback pass per
+// level, returning its index, or -1 if there is no such triangle or it cannot be subdivided on the GPU,
+// in which case it is left as it was. The packed vertex formats are left to the builder thread
+int SubdivideGrowableEntry(GeometryCache *cache, int part, int level, int variant, int format)
+{
+    int index = FindGrowableEntry(cache, part, level, variant, format);
+    if (!gpuSubdivision || part != 3 || format != 1 || index < 0 || !SubdividesToLevel(level))
+    {
+        return -1;
+    }
+    while (cache->entries[index].level < level)
+    {
+        if (!SubdivideCacheEntry(cache, index))
+        {
+            return -1;
+        }
+    }
+    return index;
+}
+
+// Uploads a shape straight from the pages of its mesh file, returning its index or -1 if there is
+// no mesh file for it. The packed vertex formats still convert the mapped floats before uploading
+int InsertMeshFile(GeometryCache *cache, int part, int level, int variant, int format)
+{
+    MappedMeshFile mesh;
+    GeometryData data;
+    if (meshDirectory.empty() || !MapMeshGeometry(part, level, variant, &mesh, &data))
+    {
+        return -1;
+    }
+    int index = InsertGeometry(cache, part, level, variant, format, data, MyGeometry());
+    UnmapMeshFile(&mesh);
+    if (index >= 0)
+    {
+        cache->meshLoads++;
+    }
+    return index;
+}
+
+// Marks the entry at index as displayed and evicts old entries if the cache goes over its budget,
+// returning the geometry of the entry drawn at level. Lower levels of a grown shape draw a prefix of it
+MyGeometry DisplayCacheEntry(GeometryCache *cache, int index, int level, GLuint *mode)
+{
+    CacheEntry key = cache->entries[index];
+    cache->entries[index].lastUsed = ++cache->clock;
+    EvictGeometry(cache, index);
+
+    index = FindCacheEntry(cache, key.part, key.level, key.variant, key.format);
+    *mode = cache->entries[index].renderMode;
+    MyGeometry displayed = cache->entries[index].geometry;
+    if (level != key.level)
+    {
+        displayed.elementCount = GrowingVertexCount(key.part, level);
+    }
+    return displayed;
+}
+
+// Sets displayed to the geometry for (part, level) if it is resident and returns true, or returns
+// false on a miss so that the caller can have it built
+bool AcquireGeometry(GeometryCache *cache, int part, int level, MyGeometry *displayed, GLuint *mode)
+{
+    int variant = GeometryVariant(part);
+    int index = FindCacheEntry(cache, part, level, variant, GeometryFormat(part, variant));
+    if (index < 0)
+    {
+        cache->misses++;
+        return false;
+    }
+    cache->hits++;
+    *displayed = DisplayCacheEntry(cache, index, level, mode);
+    return true;
+}
+
+// Prebuilds the next missing (part, level) combination, returning false once
+// every combination has been visited or the budget is full
+bool WarmUpGeometryCache(GeometryCache *cache)
+{
+    while (cache->warmupNext >= 0 && cache->warmupNext < NUMBER_OF_PARTS * NUMBER_OF_LEVELS)
+    {
+        int part = cache->warmupNext / NUMBER_OF_LEVELS + 1;
+        int level = cache->warmupNext % NUMBER_OF_LEVELS + 1;
+        cache->warmupNext++;
+        if (cache->residentBytes >= cache->budgetBytes)
+        {
+            break;
+        }
+        int variant = GeometryVariant(part);
+        int format = GeometryFormat(part, variant);
+        if (FindCacheEntry(cache, part, level, variant, format) < 0)
+        {
+            // warm-up entries are the least recently used until they are displayed,
+            // and warming stops as soon as one of them does not fit
+            if (InsertMeshFile(cache, part, level, variant, format) < 0)
+            {
+                GeometryData data;
+                MyGeometry buffers;
+                GeometrySink sink(&data, mappedGeometrySink ? &buffers : 0, format);
+                if (GenerateGeometry(part, level, variant, &sink))
+                {
+                    InsertGeometry(cache, part, level, variant, format, data, buffers);
+                }
+                else
+                {
+                    DestroyGeometry(&buffers);
+                }
+            }
+            if (cache->residentBytes > cache->budgetBytes)
+            {
+                int current = GeometryVariant(PART);
+                EvictGeometry(cache, FindCacheEntry(cache, PART, LEVEL, current, GeometryFormat(PART, current)));
+                break;
+            }
+            return true;
+        }
+    }
+    cache->warmupNext = -1;
+    return false;
+}
+
+// Prints hit and miss counts and the memory held by the cache
+void PrintCacheStats(GeometryCache *cache)
+{
+    cout << "Geometry cache: " << cache->hits << " hits, " << cache->misses << " misses ("
+         << cache->meshLoads << " loaded from mesh files, " << cache->levelSteps << " grown from a lower level), " << cache->evictions << " evictions, " << cache->entries.size() << " resident shapes using "
+         << cache->residentBytes << " of " << cache->budgetBytes << " bytes" << endl;
+
+    // resident vertices and bytes in each vertex format, to compare their sizes
+    for (int format = 1; format <= NUMBER_OF_VERTEX_FORMATS; format++)
+    {
+        GLsizeiptr bytes = 0;
+        long long vertices = 0;
+        for (size_t i = 0; i < cache->entries.size(); i++)
+        {
+            const CacheEntry &entry = cache->entries[i];
+            if (entry.format == format && GeometryHasVertexArrays(entry.part, entry.variant))
+            {
+                bytes += cache->entries[i].geometry.bufferBytes;
+                vertices += cache->entries[i].geometry.vertexCount;
+            }
+        }
+        if (vertices > 0)
+        {
+            cout << "  " << VertexFormatName(format) << ": " << vertices << " vertices in " << bytes
+                 << " bytes" << endl;
+        }
+    }
+}
+
+// Releases every resident shape
+void DestroyGeometryCache(GeometryCache *cache)
+{
+    for (size_t i = 0; i < cache->entries.size(); i++)
+    {
+        DestroyGeometry(&cache->entries[i].geometry);
+    }
+    cache->entries.clear();
+    cache->residentBytes = 0;
+}
+
+// --------------------------------------------------------------------------
+// Asynchronous geometry builds
+
+// A shape for the builder thread to generate
+struct BuildRequest
+{
+    int part;
+    int level;
+    int firstLevel;             // level of the cached entry to append the others to, zero to build it all
+    int variant;
+    int format;
+    unsigned long id;           // zero when there is no request
+};
+
+// Generates shapes missing from the cache on a worker thread, so that the window keeps drawing the
+// previous scene instead of freezing. Only the newest request is kept: a request that is replaced
+// before it starts is never generated, and one replaced while generating stops at the next check of
+// the generators and its buffers are deleted. With a context of its own the worker generates straight
+// into mapped buffers, which the context of the window shares, and the render thread only has to
+// create their vertex array
+struct GeometryBuilder
+{
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    GLFWwindow *context;        // hidden window sharing buffers with the main one, null to generate into vectors
+    BuildRequest pending;       // waiting for the worker
+    BuildRequest finished;      // generated and waiting for the render thread to upload it
+    GeometryData finishedData;
+    MyGeometry finishedBuffers; // arrays the worker already wrote into buffers
+    GLsync finishedFence;       // signalled once those buffers are complete, zero without buffers
+    bool finishedOk;
+    atomic<unsigned long> latest;   // request the render thread waits for, zero when it waits for none. The
+                                    // worker generating any other request gives up, see GeometryCancel
+    unsigned long nextId;
+    unsigned long abandoned;    // requests dropped because a newer one arrived first
+    bool quit;
+
+    GeometryBuilder() : context(0), finishedFence(0), finishedOk(false), latest(0), nextId(0), abandoned(0), quit(false)
+    {
+        pending.id = 0;
+        finished.id = 0;
+    }
+};
+GeometryBuilder builder;
+
+// Time from a key press that changes the scene to the first frame drawn with the new scene
+struct SceneLatency
+{
+    double requestTime;         // glfwGetTime() of the change still to be shown, negative when none
+    unsigned long changes;
+    double last;                // all in seconds
+    double total;
+    double longest;
+
+    SceneLatency() : requestTime(-1.0), changes(0), last(0.0), total(0.0), longest(0.0)
+    {}
+};
+SceneLatency latency;
+
+// Hands generated arrays over without copying them, the pointers stay valid since the vectors only
+// exchange their storage
+void MoveGeometryData(GeometryData *to, GeometryData *from)
+{
+    to->vertexArray.swap(from->vertexArray);
+    to->colourArray.swap(from->colourArray);
+    to->instanceArray.swap(from->instanceArray);
+    to->indexArray.swap(from->indexArray);
+    to->vertices = from->vertices;
+    to->colours = from->colours;
+    to->vertexCount = from->vertexCount;
+    to->instances = from->instances;
+    to->instanceCount = from->instanceCount;
+    to->indices = from->indices;
+    to->indexCount = from->indexCount;
+    to->indexBytes = from->indexBytes;
+}
+
+// Deletes the buffers and fence of a finished build that will not be displayed. Buffers are shared
+// between the contexts, so either thread may call this with the lock held
+void ReleaseFinishedBuild(GeometryBuilder *builder)
+{
+    DestroyGeometry(&builder->finishedBuffers);
+    builder->finishedBuffers = MyGeometry();
+    if (builder->finishedFence != 0)
+    {
+        glDeleteSync(builder->finishedFence);
+        builder->finishedFence = 0;
+    }
+    builder->finished.id = 0;
+}
+
+// Main loop of the builder thread, the arrays are generated outside the lock
+void RunGeometryBuilder(GeometryBuilder *builder)
+{
+    if (builder->context != 0)
+    {
+        glfwMakeContextCurrent(builder->context);
+#ifndef RELEASE
+        // debug output belongs to each context
+        if (debugOutput)
+        {
+            EnableDebugOutput();
+        }
+#endif
+    }
+    unique_lock<mutex> guard(builder->lock);
+    while (true)
+    {
+        while (!builder->quit && builder->pending.id == 0)
+        {
+            builder->wake.wait(guard);
+        }
+        if (builder->quit)
+        {
+            break;
+        }
+        BuildRequest request = builder->pending;
+        builder->pending.id = 0;
+        guard.unlock();
+
+        GeometryData data;
+        MyGeometry buffers;
+        GeometrySink sink(&data, builder->context != 0 ? &buffers : 0, request.format);
+        GeometryCancel cancel(&builder->latest, request.id);
+        sink.cancel = &cancel;
+        bool generated;
+        if (request.firstLevel > 0)
+        {
+            generated = GenerateGeometryLevels(request.part, request.firstLevel, request.level, &sink);
+        }
+        else
+        {
+            generated = GenerateGeometry(request.part, request.level, request.variant, &sink);
+        }
+        GLsync fence = 0;
+        if (sink.geometry != 0 && !GeometryCancelled(&cancel))
+        {
+            // the render thread waits for this before it draws from the buffers
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+
+        guard.lock();
+        if (request.id != builder->latest)
+        {
+            builder->abandoned++;
+            DestroyGeometry(&buffers);
+            glDeleteSync(fence);
+            continue;
+        }
+        builder->finished = request;
+        MoveGeometryData(&builder->finishedData, &data);
+        builder->finishedBuffers = buffers;
+        builder->finishedFence = fence;
+        builder->finishedOk = generated;
+
+        // wake the render thread if it is waiting for events
+        glfwPostEmptyEvent();
+    }
+    if (builder->context != 0)
+    {
+        glfwMakeContextCurrent(0);
+    }
+}
+
+void StartGeometryBuilder(GeometryBuilder *builder)
+{
+    builder->worker = thread(RunGeometryBuilder, builder);
+}
+
+// Asks the builder thread for a shape, replacing any request it has not finished. With a firstLevel
+// only the levels after it are generated, to grow the cached entry of that level
+void RequestGeometryBuild(GeometryBuilder *builder, int part, int level, int variant, int format, int firstLevel)
+{
+    lock_guard<mutex> guard(builder->lock);
+    if (builder->pending.id != 0)
+    {
+        builder->abandoned++;
+    }
+    builder->pending.part = part;
+    builder->pending.level = level;
+    builder->pending.firstLevel = firstLevel;
+    builder->pending.variant = variant;
+    builder->pending.format = format;
+    builder->pending.id = ++builder->nextId;
+    builder->latest = builder->pending.id;
+    ReleaseFinishedBuild(builder);
+    builder->wake.notify_one();
+}
+
+// Drops any request not uploaded yet, used when the new scene is already in the cache
+void CancelGeometryBuild(GeometryBuilder *builder)
+{
+    lock_guard<mutex> guard(builder->lock);
+    if (builder->pending.id != 0)
+    {
+        builder->abandoned++;
+        builder->pending.id = 0;
+    }
+    ReleaseFinishedBuild(builder);
+    builder->latest = 0;
+}
+
+// Uploads the shape the render thread is waiting for once the builder thread has generated it, and
+// makes it the displayed geometry. Until then the previous scene keeps being drawn from its own buffers
+void AdoptFinishedGeometry(GeometryBuilder *builder, GeometryCache *cache, SceneLatency *latency)
+{
+    GeometryData data;
+    MyGeometry buffers;
+    GLsync fence;
+    BuildRequest request;
+    bool generated;
+    {
+        lock_guard<mutex> guard(builder->lock);
+        if (builder->finished.id == 0 || builder->finished.id != builder->latest)
+        {
+            return;
+        }
+        request = builder->finished;
+        generated = builder->finishedOk;
+        MoveGeometryData(&data, &builder->finishedData);
+        buffers = builder->finishedBuffers;
+        fence = builder->finishedFence;
+        builder->finishedBuffers = MyGeometry();
+        builder->finishedFence = 0;
+        builder->finished.id = 0;
+        builder->latest = 0;
+    }
+
+    // later commands of this context wait for the writes of the builder context to land
+    if (fence != 0)
+    {
+        glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+    }
+    int index = -1;
+    if (generated && request.firstLevel > 0)
+    {
+        index = FindGrowableEntry(cache, request.part, request.level, request.variant, request.format);
+        if (index < 0 || cache->entries[index].level != request.firstLevel)
+        {
+            // the entry was evicted meanwhile, so the whole shape has to be generated after all
+            DestroyGeometry(&buffers);
+            RequestGeometryBuild(builder, request.part, request.level, request.variant, request.format, 0);
+            return;
+        }
+        if (!GrowCacheEntry(cache, index, request.level, data, &buffers))
+        {
+            index = -1;
+        }
+    }
+    else if (generated)
+    {
+        index = InsertGeometry(cache, request.part, request.level, request.variant, request.format, data, buffers);
+    }
+    else
+    {
+        DestroyGeometry(&buffers);
+    }
+    if (index < 0)
+    {
+        // the previous scene stays on screen
+        latency->requestTime = -1.0;
+        return;
+    }
+    geometry = DisplayCacheEntry(cache, index, request.level, &renderMode);
+}
+
+// True while the render thread waits for the builder thread
+bool GeometryBuildPending(GeometryBuilder *builder)
+{
+    return builder->latest != 0;
+}
+
+void StopGeometryBuilder(GeometryBuilder *builder)
+{
+    {
+        lock_guard<mutex> guard(builder->lock);
+        builder->quit = true;
+        builder->latest = 0;
+    }
+    builder->wake.notify_one();
+    if (builder->worker.joinable())
+    {
+        builder->worker.join();
+    }
+    ReleaseFinishedBuild(builder);
+}
+
+// Called after every frame, records how long the last scene change took to reach the screen
+void RecordSceneLatency(SceneLatency *latency, GeometryBuilder *builder)
+{
+    if (latency->requestTime < 0.0 || GeometryBuildPending(builder))
+    {
+        return;
+    }
+    latency->last = glfwGetTime() - latency->requestTime;
+    latency->total += latency->last;
+    latency->longest = max(latency->longest, latency->last);
+    latency->changes++;
+    latency->requestTime = -1.0;
+}
+
+void PrintSceneLatency(SceneLatency *latency, GeometryBuilder *builder)
+{
+    if (latency->changes == 0)
+    {
+        return;
+    }
+    cout << "Key press to first frame: last " << latency->last * 1000.0 << " ms, mean "
+         << latency->total * 1000.0 / latency->changes << " ms, longest " << latency->longest * 1000.0
+         << " ms over " << latency->changes << " scene changes, " << builder->abandoned
+         << " stale builds abandoned" << endl;
+}
+
+// --------------------------------------------------------------------------
+// Gallery: every part and level side by side, drawn from one vertex array
+
+const int MAX_GALLERY_TILES = 32;   // size of the tile arrays in vertex_gallery.glsl
+
+// Vertices of one primitive type from several tiles, drawn with one glMultiDrawArrays call
+struct GalleryBatch
+{
+    GLenum mode;
+    vector<GLint> firsts;
+    vector<GLsizei> counts;
+};
+
+// The shapes of every part up to a level, one after another in the buffers of one geometry. The
+// gallery program finds the tile of each vertex from its index and moves the shape into that tile,
+// so the triangles of every tile are drawn in one call and the spiral lines in another
+struct Gallery
+{
+    MyGeometry arena;
+    GalleryBatch batches[2];    // triangles and lines
+    int levels;                 // columns of the grid, one row per part
+    int tiles;
+
+    Gallery() : levels(0), tiles(0)
+    {
+        batches[0].mode = GL_TRIANGLES;
+        batches[1].mode = GL_LINES;
+    }
+};
+Gallery gallery;
+bool galleryMode = false;   // draw the gallery instead of the current shape
+
+// Scale in x and y followed by the offset that move a shape drawn in [-1, 1] into the tile of
+// (part, level) of a grid with the given levels as columns, keeping its aspect ratio
+void GalleryTileTransform(int part, int level, int levels, GLfloat *transform)
+{
+    float width = 2.0f / levels;
+    float height = 2.0f / NUMBER_OF_PARTS;
+    float scale = 0.45f * min(width, height);
+    transform[0] = scale;
+    transform[1] = scale;
+    transform[2] = -1.0f + width * (level - 0.5f);
+    transform[3] = 1.0f - height * (part - 0.5f);
+}
+
+// Generates every part from level 1 to levels into one pair of float buffers and gives the gallery
+// program the first vertex and transform of each tile. Returns false if nothing could be generated
+bool BuildGallery(Gallery *gallery, int levels)
+{
+    vector<GLfloat> vertices;
+    vector<GLfloat> colours;
+    GLint tileFirsts[MAX_GALLERY_TILES];
+    GLfloat tileTransforms[4 * MAX_GALLERY_TILES];
+    levels = min(levels, MAX_GALLERY_TILES / NUMBER_OF_PARTS);
+    gallery->levels = levels;
+    gallery->tiles = 0;
+    for (int part = 1; part <= NUMBER_OF_PARTS; part++)
+    {
+        for (int level = 1; level <= levels; level++)
+        {
+            GeometryData data;
+            GeometrySink sink(&data, 0, 1);
+            if (!GenerateGeometry(part, level, 1, &sink))
+            {
+                continue;
+            }
+            int tile = gallery->tiles++;
+            GLint first = vertices.size() / 2;
+            tileFirsts[tile] = first;
+            GalleryTileTransform(part, level, levels, &tileTransforms[4 * tile]);
+            GalleryBatch *batch = &gallery->batches[GeometryDrawMode(part, 1) == GL_LINES ? 1 : 0];
+            batch->firsts.push_back(first);
+            batch->counts.push_back(data.vertexCount);
+            vertices.insert(vertices.end(), data.vertices, data.vertices + data.vertexCount * 2);
+            colours.insert(colours.end(), data.colours, data.colours + data.vertexCount * 3);
+        }
+    }
+    if (gallery->tiles == 0)
+    {
+        return false;
+    }
+
+    MyGeometry *arena = &gallery->arena;
+    arena->elementCount = vertices.size() / 2;
+    arena->vertexCount = arena->elementCount;
+    arena->program = galleryShader.program;
+    UploadBuffer(arena, &arena->vertexBuffer, vertices.size() * sizeof(GLfloat), vertices.data());
+    UploadBuffer(arena, &arena->colourBuffer, colours.size() * sizeof(GLfloat), colours.data());
+    SetupVertexArray(arena, true);
+
+    glUseProgram(galleryShader.program);
+    glUniform1i(glGetUniformLocation(galleryShader.program, "TileCount"), gallery->tiles);
+    glUniform1iv(glGetUniformLocation(galleryShader.program, "TileFirst"), gallery->tiles, tileFirsts);
+    glUniform4fv(glGetUniformLocation(galleryShader.program, "TileTransform"), gallery->tiles, tileTransforms);
+    glUseProgram(0);
+    return !CheckGLErrors();
+}
+
+// Releases the buffers of the gallery
+void DestroyGallery(Gallery *gallery)
+{
+    DestroyGeometry(&gallery->arena);
+    gallery->arena = MyGeometry();
+    for (int i = 0; i < 2; i++)
+    {
+        gallery->batches[i].firsts.clear();
+        gallery->batches[i].counts.clear();
+    }
+    gallery->tiles = 0;
+}
+
+// Draws every tile of the gallery with one draw call per primitive type
+void RenderGallery(Gallery *gallery)
+{
+    // clear screen to a dark grey colour
+    BeginGpuTimer(&frameStats, GPU_CLEAR);
+    glClearColor(0.2, 0.2, 0.2, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    EndGpuTimer(&frameStats);
+
+    BeginGpuTimer(&frameStats, GPU_DRAW);
+    glUseProgram(gallery->arena.program);
+    glBindVertexArray(gallery->arena.vertexArray);
+    for (int i = 0; i < 2; i++)
+    {
+        const GalleryBatch &batch = gallery->batches[i];
+        if (!batch.firsts.empty())
+        {
+            glMultiDrawArrays(batch.mode, batch.firsts.data(), batch.counts.data(), batch.firsts.size());
+        }
+    }
+
+    // reset state to default (no shader or geometry bound)
+    glBindVertexArray(0);
+    glUseProgram(0);
+    EndGpuTimer(&frameStats);
+    CountDrawnVertices(&frameStats, gallery->arena.elementCount);
+
+    // check for an report any OpenGL errors
+    CheckFrameErrors();
+}
+
+// --------------------------------------------------------------------------
+// Offscreen rendering: comparison of the Sierpinski render paths and benchmark
+
+// Creates a frame buffer with one colour render buffer of the given size and binds it for drawing
+void CreateOffscreenTarget(int width, int height, GLuint *framebuffer, GLuint *renderbuffer)
+{
+    glGenRenderbuffers(1, renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, *renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenFramebuffers(1, framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, *renderbuffer);
+    glViewport(0, 0, width, height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+}
+
+// Rebinds the default frame buffer and deletes the offscreen one
+void DestroyOffscreenTarget(GLuint framebuffer, GLuint renderbuffer)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+}
+
+// Renders the geometry into the bound frame buffer and reads back its pixels
+vector<GLubyte> RenderToPixels(MyGeometry *geometry, GLuint renderMode, int width, int height)
+{
+    RenderScene(geometry, &shader, renderMode);
+    vector<GLubyte> pixels(width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+// Counts the pixels that differ from the reference and finds the largest difference of a channel. Only
+// the colour channels are compared, the fragment shader writes a zero alpha
+void ComparePixels(const vector<GLubyte> &pixels, const vector<GLubyte> &reference, int *differentPixels, int *largestDifference)
+{
+    *differentPixels = 0;
+    *largestDifference = 0;
+    for (size_t i = 0; i < pixels.size(); i += 4)
+    {
+        int difference = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            difference = max(difference, abs(pixels[i + c] - reference[i + c]));
+        }
+        if (difference > 0)
+        {
+            (*differentPixels)++;
+        }
+        *largestDifference = max(*largestDifference, difference);
+    }
+}
+
+// Renders every level in each Sierpinski mode into an offscreen frame buffer and compares the pixels
+// against the vertex array path, returning false if a colour differs by more than one step anywhere
+bool CompareSierpinskiModes(int width, int height)
+{
+    GLuint framebuffer, renderbuffer;
+    CreateOffscreenTarget(width, height, &framebuffer, &renderbuffer);
+
+    bool matches = true;
+    for (int level = 1; level <= NUMBER_OF_LEVELS; level++)
+    {
+        vector<GLubyte> reference;
+        for (int mode = 1; mode <= NUMBER_OF_SIERPINSKI_MODES; mode++)
+        {
+            // the chaos game only samples the triangle, so its pixels are not meant to match
+            if (mode == 5)
+            {
+                continue;
+            }
+            MyGeometry shape;
+            GLuint renderMode;
+            if (!BuildGeometry(3, level, mode, 1, &shape, &renderMode))
+            {
+                DestroyGeometry(&shape);
+                matches = false;
+                continue;
+            }
+            vector<GLubyte> pixels = RenderToPixels(&shape, renderMode, width, height);
+            DestroyGeometry(&shape);
+            if (mode == 1)
+            {
+                reference = pixels;
+                continue;
+            }
+            if (reference.empty())
+            {
+                continue;
+            }
+
+            int differentPixels, largestDifference;
+            ComparePixels(pixels, reference, &differentPixels, &largestDifference);
+            cout << "Level " << level << " drawn " << SierpinskiModeName(mode) << ": " << differentPixels
+                 << " pixels differ, by at most " << largestDifference << endl;
+            if (largestDifference > 1)
+            {
+                matches = false;
+            }
+        }
+    }
+
+    DestroyOffscreenTarget(framebuffer, renderbuffer);
+    return matches;
+}
+
+// Draws every part up to the given level offscreen, once as separate shapes with a viewport, vertex
+// array and draw call each and once as the gallery, and prints the CPU time spent submitting the
+// draws of a frame and the whole frame time of each. Returns false if the shapes could not be built
+bool CompareGalleryDraws(int width, int height, int levels)
+{
+    const int FRAMES = 200;
+    GLuint framebuffer, renderbuffer;
+    CreateOffscreenTarget(width, height, &framebuffer, &renderbuffer);
+
+    Gallery batched;
+    bool built = BuildGallery(&batched, levels);
+    levels = batched.levels;
+    vector<MyGeometry> shapes;
+    vector<GLuint> modes;
+    vector<GLint> viewports;
+    for (int part = 1; part <= NUMBER_OF_PARTS && built; part++)
+    {
+        for (int level = 1; level <= levels; level++)
+        {
+            MyGeometry shape;
+            GLuint mode;
+            if (!BuildGeometry(part, level, 1, 1, &shape, &mode))
+            {
+                DestroyGeometry(&shape);
+                continue;
+            }
+            // the viewport covering the same square as the transform of the gallery tile
+            GLfloat transform[4];
+            GalleryTileTransform(part, level, levels, transform);
+            viewports.push_back((GLint)((transform[2] - transform[0] + 1.0f) * 0.5f * width));
+            viewports.push_back((GLint)((transform[3] - transform[1] + 1.0f) * 0.5f * height));
+            viewports.push_back((GLint)(transform[0] * width));
+            viewports.push_back((GLint)(transform[1] * height));
+            shapes.push_back(shape);
+            modes.push_back(mode);
+        }
+    }
+
+    // the first frame of each is not timed since drivers finish setting up state on first use
+    double submitTime[2] = { 0.0, 0.0 };
+    double frameTime[2] = { 0.0, 0.0 };
+    for (int batchedDraws = 0; batchedDraws < 2 && built; batchedDraws++)
+    {
+        for (int frame = 0; frame <= FRAMES; frame++)
+        {
+            glFinish();
+            double start = glfwGetTime();
+            if (batchedDraws)
+            {
+                RenderGallery(&batched);
+            }
+            else
+            {
+                glClearColor(0.2, 0.2, 0.2, 1.0);
+                glClear(GL_COLOR_BUFFER_BIT);
+                for (size_t i = 0; i < shapes.size(); i++)
+                {
+                    glViewport(viewports[4 * i], viewports[4 * i + 1], viewports[4 * i + 2], viewports[4 * i + 3]);
+                    DrawGeometry(&shapes[i], &shader, modes[i]);
+                }
+                glViewport(0, 0, width, height);
+                CheckGLErrors();
+            }
+            double submitted = glfwGetTime();
+            glFinish();
+            if (frame > 0)
+            {
+                submitTime[batchedDraws] += submitted - start;
+                frameTime[batchedDraws] += glfwGetTime() - start;
+            }
+        }
+    }
+    if (built)
+    {
+        cout << "Gallery of " << batched.tiles << " shapes in " << batched.arena.vertexCount << " vertices over "
+             << FRAMES << " frames" << endl;
+        cout << "  separate draws: " << shapes.size() << " draw calls, " << submitTime[0] * 1000.0 / FRAMES
+             << " ms to submit, " << frameTime[0] * 1000.0 / FRAMES << " ms per frame" << endl;
+        cout << "  gallery: " << (batched.batches[0].firsts.empty() ? 0 : 1) + (batched.batches[1].firsts.empty() ? 0 : 1)
+             << " draw calls, " << submitTime[1] * 1000.0 / FRAMES << " ms to submit, "
+             << frameTime[1] * 1000.0 / FRAMES << " ms per frame" << endl;
+    }
+
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        DestroyGeometry(&shapes[i]);
+    }
+    DestroyGallery(&batched);
+    DestroyOffscreenTarget(framebuffer, renderbuffer);
+    return built;
+}
+
+// Reads the first count floats of a buffer back
+vector<GLfloat> ReadBufferFloats(GLuint buffer, size_t count)
+{
+    vector<GLfloat> values(count);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, values.size() * sizeof(GLfloat), values.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return values;
+}
+
+// Counts the floats of buffer that differ from expected and keeps the largest difference
+void CompareBufferFloats(GLuint buffer, const vector<GLfloat> &expected, long long *different, double *largest)
+{
+    vector<GLfloat> values = ReadBufferFloats(buffer, expected.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        double difference = fabs((double)values[i] - expected[i]);
+        *largest = max(*largest, difference);
+        *different += values[i] != expected[i];
+    }
+}
+
+// Time in milliseconds from asking for a shape to the GPU having its buffers ready to draw, best of a
+// few builds
+double LevelSwitchTime(int part, int level, bool compute)
+{
+    const int BUILDS = 5;
+    bool enabled = computeGeometry.enabled;
+    computeGeometry.enabled = compute;
+    double best = 0.0;
+    for (int build = 0; build < BUILDS; build++)
+    {
+        MyGeometry shape;
+        GLuint mode;
+        glFinish();
+        double start = glfwGetTime();
+        BuildGeometry(part, level, 1, 1, &shape, &mode);
+        glFinish();
+        double elapsed = glfwGetTime() - start;
+        best = build == 0 ? elapsed : min(best, elapsed);
+        DestroyGeometry(&shape);
+    }
+    computeGeometry.enabled = enabled;
+    return best * 1000.0;
+}
+
+// Generates the spiral and the Sierpinski triangle at levels 1 to maxLevel once on the CPU and once with
+// the compute shaders, prints how many of their floats differ and the time a level switch takes with
+// each, and returns false if a float differs by more than the tolerance
+bool CompareComputeGeometry(int maxLevel)
+{
+    const double TOLERANCE = 1.0e-6;
+    const char *names[] = { "Spiral", "Sierpinski triangle" };
+    bool passed = true;
+    for (int part = 2; part <= 3; part++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            GeometryData expected;
+            GeometrySink cpuSink(&expected, 0, 1);
+            GeometryData data;
+            MyGeometry buffers;
+            GeometrySink gpuSink(&data, &buffers, 1);
+            if (!GenerateGeometry(part, level, 1, &cpuSink) || !GenerateGeometry(part, level, 1, &gpuSink))
+            {
+                DestroyGeometry(&buffers);
+                passed = false;
+                continue;
+            }
+            if (!gpuSink.computed)
+            {
+                cout << names[part - 2] << " level " << level << ": too large for one dispatch" << endl;
+                DestroyGeometry(&buffers);
+                continue;
+            }
+
+            long long different = 0;
+            double largest = 0.0;
+            CompareBufferFloats(buffers.vertexBuffer, expected.vertexArray, &different, &largest);
+            CompareBufferFloats(buffers.colourBuffer, expected.colourArray, &different, &largest);
+            DestroyGeometry(&buffers);
+            double cpuTime = LevelSwitchTime(part, level, false);
+            double gpuTime = LevelSwitchTime(part, level, true);
+            cout << names[part - 2] << " level " << level << ": " << different << " of "
+                 << expected.vertexArray.size() + expected.colourArray.size() << " floats differ, by at most "
+                 << largest << "; level switch " << cpuTime << " ms on the CPU, " << gpuTime
+                 << " ms with compute shaders" << endl;
+            passed = passed && largest <= TOLERANCE;
+        }
+    }
+    return passed;
+}
+
+// Inserts the Sierpinski triangle of level, generated on this thread, into the cache and returns its index
+int InsertSierpinski(GeometryCache *cache, int level)
+{
+    GeometryData data;
+    GeometrySink sink(&data, 0, 1);
+    if (!GenerateGeometry(3, level, 1, &sink))
+    {
+        return -1;
+    }
+    return InsertGeometry(cache, 3, level, 1, 1, data, MyGeometry());
+}
+
+// Adds one level to the Sierpinski triangle at index on the CPU, as the builder thread and
+// AdoptFinishedGeometry() do
+bool GrowSierpinski(GeometryCache *cache, int index)
+{
+    int level = cache->entries[index].level;
+    GeometryData data;
+    MyGeometry tail;
+    GeometrySink sink(&data, mappedGeometrySink ? &tail : 0, 1);
+    return GenerateGeometryLevels(3, level, level + 1, &sink) && GrowCacheEntry(cache, index, level + 1, data, &tail);
+}
+
+// Counts the floats of the buffers of two shapes that differ and keeps the largest difference, a shape
+// with another number of vertices counts as entirely different
+void CompareGeometryFloats(const MyGeometry &expected, const MyGeometry &actual, long long *different, double *largest)
+{
+    if (expected.vertexCount != actual.vertexCount)
+    {
+        *different += expected.vertexCount * 5;
+        *largest = HUGE_VAL;
+        return;
+    }
+    CompareBufferFloats(actual.vertexBuffer, ReadBufferFloats(expected.vertexBuffer, expected.vertexCount * 2), different, largest);
+    CompareBufferFloats(actual.colourBuffer, ReadBufferFloats(expected.colourBuffer, expected.vertexCount * 3), different, largest);
+}
+
+// Steps the Sierpinski triangle up to every level from 2 to maxLevel from the one below, once on the CPU
+// and once with a transform feedback pass, prints how many floats of the two differ and the time each
+// step takes, best of a few. Triangles grown from level 1 one level at a time are compared as well, since
+// they keep their last level in another place. Returns false if a float differs by more than the tolerance
+bool CompareSubdivision(int maxLevel)
+{
+    const double TOLERANCE = 1.0e-6;
+    const int STEPS = 5;
+    GeometryCache steps;
+    int cpuGrown = InsertSierpinski(&steps, 1);
+    int gpuGrown = InsertSierpinski(&steps, 1);
+    bool passed = cpuGrown >= 0 && gpuGrown >= 0;
+    for (int level = 2; level <= maxLevel && passed; level++)
+    {
+        if (!SubdividesToLevel(level))
+        {
+            cout << "Sierpinski triangle level " << level << ": too large to subdivide on the GPU" << endl;
+            break;
+        }
+        long long different = 0;
+        double largest = 0.0;
+        double cpuTime = 0.0;
+        double gpuTime = 0.0;
+        for (int step = 0; step < STEPS && passed; step++)
+        {
+            int cpuIndex = InsertSierpinski(&steps, level - 1);
+            int gpuIndex = InsertSierpinski(&steps, level - 1);
+            glFinish();
+            double start = glfwGetTime();
+            passed = GrowSierpinski(&steps, cpuIndex);
+            glFinish();
+            double cpuElapsed = glfwGetTime() - start;
+            start = glfwGetTime();
+            passed = SubdivideCacheEntry(&steps, gpuIndex) && passed;
+            glFinish();
+            double gpuElapsed = glfwGetTime() - start;
+            cpuTime = step == 0 ? cpuElapsed : min(cpuTime, cpuElapsed);
+            gpuTime = step == 0 ? gpuElapsed : min(gpuTime, gpuElapsed);
+            if (step == 0)
+            {
+                CompareGeometryFloats(steps.entries[cpuIndex].geometry, steps.entries[gpuIndex].geometry, &different, &largest);
+            }
+            DestroyGeometry(&steps.entries[gpuIndex].geometry);
+            DestroyGeometry(&steps.entries[cpuIndex].geometry);
+            steps.entries.erase(steps.entries.begin() + gpuIndex);
+            steps.entries.erase(steps.entries.begin() + cpuIndex);
+        }
+
+        long long grownDifferent = 0;
+        passed = GrowSierpinski(&steps, cpuGrown) && SubdivideCacheEntry(&steps, gpuGrown) && passed;
+        CompareGeometryFloats(steps.entries[cpuGrown].geometry, steps.entries[gpuGrown].geometry, &grownDifferent, &largest);
+        cout << "Sierpinski triangle level " << level << ": " << different << " of "
+             << steps.entries[cpuGrown].geometry.vertexCount * 5 << " floats differ, " << grownDifferent
+             << " when grown from level 1, by at most " << largest << "; step up " << cpuTime * 1000.0
+             << " ms on the CPU, " << gpuTime * 1000.0 << " ms with transform feedback" << endl;
+        passed = passed && largest <= TOLERANCE;
+    }
+    DestroyGeometryCache(&steps);
+    return passed;
+}
+
+// Adds one level to the shape of part at index in the palette format, as the builder thread and
+// AdoptFinishedGeometry() do, or inserts its first level if index is negative. Returns its index, or
+// -1 if it could not be built
+int GrowPaletteShape(GeometryCache *cache, int part, int index, int level)
+{
+    GeometryData data;
+    MyGeometry tail;
+    if (index < 0)
+    {
+        GeometrySink sink(&data, 0, 4);
+        return GenerateGeometry(part, level, 1, &sink) ? InsertGeometry(cache, part, level, 1, 4, data, MyGeometry()) : -1;
+    }
+    GeometrySink sink(&data, mappedGeometrySink ? &tail : 0, 4);
+    bool grown = GenerateGeometryLevels(part, level - 1, level, &sink) && GrowCacheEntry(cache, index, level, data, &tail);
+    return grown ? index : -1;
+}
+
+// Renders every part up to maxLevel offscreen with its colours in buffers and again in the palette
+// format, prints how many pixels differ and the bytes and upload time of both. The shapes that grow are
+// also grown from level 1 in the palette format, whose appended levels are coloured differently by the
+// shader. Returns false if any pixel differs
+bool ComparePalette(int width, int height, int maxLevel)
+{
+    GLuint framebuffer, renderbuffer;
+    CreateOffscreenTarget(width, height, &framebuffer, &renderbuffer);
+
+    bool matches = true;
+    for (int part = 1; part <= NUMBER_OF_PARTS; part++)
+    {
+        GeometryCache grown;
+        int grownIndex = -1;
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            MyGeometry stored, computed;
+            GLuint renderMode;
+            if (!BuildGeometry(part, level, 1, 1, &stored, &renderMode) || !BuildGeometry(part, level, 1, 4, &computed, &renderMode))
+            {
+                DestroyGeometry(&stored);
+                DestroyGeometry(&computed);
+                matches = false;
+                continue;
+            }
+            vector<GLubyte> reference = RenderToPixels(&stored, renderMode, width, height);
+            int differentPixels, largestDifference;
+            ComparePixels(RenderToPixels(&computed, renderMode, width, height), reference, &differentPixels, &largestDifference);
+            cout << "Part " << part << " level " << level << ": " << differentPixels << " pixels differ";
+
+            if (GeometryGrows(part, 1))
+            {
+                grownIndex = GrowPaletteShape(&grown, part, grownIndex, level);
+                int grownPixels = width * height;
+                int grownDifference = 255;
+                if (grownIndex >= 0)
+                {
+                    ComparePixels(RenderToPixels(&grown.entries[grownIndex].geometry, renderMode, width, height), reference,
+                                  &grownPixels, &grownDifference);
+                }
+                cout << ", " << grownPixels << " when grown from level 1";
+                largestDifference = max(largestDifference, grownDifference);
+            }
+            cout << ", by at most " << largestDifference << "; " << stored.bufferBytes << " bytes uploaded in "
+                 << stored.uploadSeconds * 1000.0 << " ms with colour buffers, " << computed.bufferBytes << " bytes in "
+                 << computed.uploadSeconds * 1000.0 << " ms from the palette" << endl;
+            matches = matches && largestDifference == 0;
+            DestroyGeometry(&stored);
+            DestroyGeometry(&computed);
+        }
+        DestroyGeometryCache(&grown);
+    }
+
+    DestroyOffscreenTarget(framebuffer, renderbuffer);
+    return matches;
+}
+
+// Builds every shape drawn through an index buffer up to maxLevel on a builder thread and hands it to a
+// cache as the window does, once generated into vectors and once into the mapped buffers of a context
+// sharing those of the window. Prints how many pixels differ from the shape built by BuildGeometry() and
+// returns false if any pixel differs
+bool CompareBuilderHandOff(GLFWwindow *window, int width, int height, int maxLevel)
+{
+    GLuint framebuffer, renderbuffer;
+    CreateOffscreenTarget(width, height, &framebuffer, &renderbuffer);
+
+    bool matches = true;
+    for (int mapped = 0; mapped < 2; mapped++)
+    {
+        GeometryBuilder handOff;
+        if (mapped)
+        {
+            glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+            handOff.context = glfwCreateWindow(1, 1, "Geometry builder", 0, window);
+        }
+        GeometryCache handOffCache;
+        SceneLatency handOffLatency;
+        StartGeometryBuilder(&handOff);
+        for (int part = 1; part <= NUMBER_OF_PARTS; part++)
+        {
+            for (int variant = 1; variant <= NUMBER_OF_SIERPINSKI_MODES; variant++)
+            {
+                if (!GeometryIndexed(part, variant))
+                {
+                    continue;
+                }
+                for (int level = 1; level <= maxLevel; level++)
+                {
+                    MyGeometry shape;
+                    GLuint mode;
+                    if (!BuildGeometry(part, level, variant, 1, &shape, &mode))
+                    {
+                        DestroyGeometry(&shape);
+                        matches = false;
+                        continue;
+                    }
+                    vector<GLubyte> reference = RenderToPixels(&shape, mode, width, height);
+                    DestroyGeometry(&shape);
+
+                    // the builder thread wakes this one once the shape is generated
+                    RequestGeometryBuild(&handOff, part, level, variant, 1, 0);
+                    while (GeometryBuildPending(&handOff))
+                    {
+                        glfwWaitEvents();
+                        AdoptFinishedGeometry(&handOff, &handOffCache, &handOffLatency);
+                    }
+                    if (FindCacheEntry(&handOffCache, part, level, variant, 1) < 0)
+                    {
+                        cout << "Part " << part << " mode " << variant << " level " << level
+                             << " could not be built on the builder thread" << endl;
+                        matches = false;
+                        continue;
+                    }
+                    vector<GLubyte> pixels = RenderToPixels(&geometry, renderMode, width, height);
+
+                    int differentPixels, largestDifference;
+                    ComparePixels(pixels, reference, &differentPixels, &largestDifference);
+                    cout << "Part " << part << " mode " << variant << " level " << level << " handed over from "
+                         << (mapped ? "mapped buffers" : "vectors") << ": " << differentPixels
+                         << " pixels differ, by at most " << largestDifference << endl;
+                    if (differentPixels > 0)
+                    {
+                        matches = false;
+                    }
+                }
+            }
+        }
+        StopGeometryBuilder(&handOff);
+        if (handOff.context != 0)
+        {
+            glfwDestroyWindow(handOff.context);
+        }
+        DestroyGeometryCache(&handOffCache);
+        geometry = MyGeometry();
+    }
+
+    DestroyOffscreenTarget(framebuffer, renderbuffer);
+    return matches;
+}
+
+const int BENCHMARK_FRAMES = 100;   // timed frames per shape in the benchmark
+
+// Measurements of one shape in the benchmark, times are in milliseconds
+struct BenchmarkResult
+{
+    int part;
+    int level;
+    int variant;
+    int format;
+    GLsizei vertices;           // vertices drawn per frame, counting every instance and every index
+    GLsizei storedVertices;     // vertices in the buffers, fewer than drawn when they are indexed
+    long long shaderInvocations; // vertex shader invocations per frame, negative when they cannot be counted
+    GLsizeiptr bytes;
+    double generateTime;        // building the shape on the CPU
+    double uploadTime;          // handing the buffers to OpenGL until it is done with them
+    double loadTime;            // mapping the mesh file and uploading from it instead, negative without one
+    double drawTime;            // GPU time per frame from timer queries
+    double framesPerSecond;     // frames drawn and finished per second of wall clock time
+    long peakResident;          // largest resident memory of the process so far, in kilobytes
+    unsigned int checksum;      // FNV-1a hash of the last frame, to spot rendering changes
+};
+
+// Hashes the colour channels of the pixels, the alpha written by the fragment shader is ignored
+unsigned int PixelChecksum(const vector<GLubyte> &pixels)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        if (i % 4 != 3)
+        {
+            hash = (hash ^ pixels[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// Largest resident memory of the process so far in kilobytes. It only grows, so in a sweep of rising
+// levels it shows what the deepest shape built so far needed at its peak
+long PeakResidentKilobytes()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// True if the context supports the named OpenGL extension
+bool HasExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        if (strcmp(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)), name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Builds, uploads and draws one shape offscreen, filling in its measurements. Queries holds one timer
+// query for each of the BENCHMARK_FRAMES frames, so none is read before the last frame is drawn and the
+// frames per second measure throughput rather than a round trip per frame. Invocations is a pipeline
+// statistics query counting vertex shader invocations, zero when they cannot be counted.
+// Returns false if the shape could not be built
+bool BenchmarkGeometry(BenchmarkResult *result, int width, int height, const GLuint *queries, GLuint invocations)
+{
+    MyGeometry shape;
+    GLuint mode;
+
+    // the upload is only finished once OpenGL has consumed the buffers
+    glFinish();
+    double start = glfwGetTime();
+    if (!BuildGeometry(result->part, result->level, result->variant, result->format, &shape, &mode))
+    {
+        DestroyGeometry(&shape);
+        return false;
+    }
+    double uploadStart = glfwGetTime();
+    glFinish();
+    double end = glfwGetTime();
+    result->uploadTime = (shape.uploadSeconds + end - uploadStart) * 1000.0;
+    result->generateTime = (end - start) * 1000.0 - result->uploadTime;
+    result->vertices = shape.elementCount * max(shape.instanceCount, 1);
+    result->storedVertices = shape.vertexCount;
+    result->bytes = shape.bufferBytes;
+    result->peakResident = PeakResidentKilobytes();
+
+    // the same shape uploaded straight from the pages of its pregenerated mesh file
+    result->loadTime = -1.0;
+    if (!meshDirectory.empty())
+    {
+        MyGeometry loaded;
+        GLuint loadedMode;
+        MappedMeshFile mesh;
+        GeometryData data;
+        start = glfwGetTime();
+        if (MapMeshGeometry(result->part, result->level, result->variant, &mesh, &data)
+            && InitializeGeometry(result->part, result->level, result->variant, result->format, data, &loaded, &loadedMode))
+        {
+            glFinish();
+            result->loadTime = (glfwGetTime() - start) * 1000.0;
+        }
+        UnmapMeshFile(&mesh);
+        DestroyGeometry(&loaded);
+    }
+
+    // the first frame is not timed since drivers finish setting up state on first use, it counts the
+    // vertex shader invocations instead, which indices can lower below the vertices drawn
+    result->shaderInvocations = -1;
+    if (invocations != 0)
+    {
+        glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, invocations);
+    }
+    RenderScene(&shape, &shader, mode);
+    if (invocations != 0)
+    {
+        glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+        GLuint64 count = 0;
+        glGetQueryObjectui64v(invocations, GL_QUERY_RESULT, &count);
+        result->shaderInvocations = count;
+    }
+    glFinish();
+    start = glfwGetTime();
+    for (int i = 0; i < BENCHMARK_FRAMES; i++)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+        RenderScene(&shape, &shader, mode);
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    glFinish();
+    result->framesPerSecond = BENCHMARK_FRAMES / (glfwGetTime() - start);
+    GLuint64 gpuTime = 0;
+    for (int i = 0; i < BENCHMARK_FRAMES; i++)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+        gpuTime += elapsed;
+    }
+    result->drawTime = gpuTime / 1.0e6 / BENCHMARK_FRAMES;
+
+    vector<GLubyte> pixels(width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    result->checksum = PixelChecksum(pixels);
+    DestroyGeometry(&shape);
+    return true;
+}
+
+// Writes the results as JSON when the file name ends in .json and as CSV otherwise. Rows are in
+// the same order and with the same precision on every run, so results of two builds can be diffed
+bool WriteBenchmarkResults(const vector<BenchmarkResult> &results, const string &filename)
+{
+    ofstream file(filename.c_str());
+    if (!file)
+    {
+        cout << "ERROR: could not open benchmark file " << filename << endl;
+        return false;
+    }
+    bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    file.setf(ios::fixed);
+    file.precision(3);
+    if (json)
+    {
+        file << "[" << endl;
+    }
+    else
+    {
+        file << "part,level,mode,format,vertices,stored_vertices,vs_invocations,bytes,generate_ms,upload_ms,load_ms,draw_ms,fps,peak_rss_kb,checksum" << endl;
+    }
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &r = results[i];
+        if (json)
+        {
+            file << "  {\"part\": " << r.part << ", \"level\": " << r.level << ", \"mode\": " << r.variant
+                 << ", \"format\": " << r.format << ", \"vertices\": " << r.vertices << ", \"stored_vertices\": " << r.storedVertices
+                 << ", \"vs_invocations\": " << r.shaderInvocations << ", \"bytes\": " << r.bytes
+                 << ", \"generate_ms\": " << r.generateTime << ", \"upload_ms\": " << r.uploadTime
+                 << ", \"load_ms\": " << r.loadTime << ", \"draw_ms\": " << r.drawTime << ", \"fps\": " << r.framesPerSecond
+                 << ", \"peak_rss_kb\": " << r.peakResident
+                 << ", \"checksum\": \"" << hex << r.checksum << dec << "\"}"
+                 << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        else
+        {
+            file << r.part << "," << r.level << "," << r.variant << "," << r.format << "," << r.vertices << ","
+                 << r.storedVertices << "," << r.shaderInvocations << "," << r.bytes << "," << r.generateTime << "," << r.uploadTime << "," << r.loadTime << "," << r.drawTime << ","
+                 << r.framesPerSecond << "," << r.peakResident << "," << hex << r.checksum << dec << endl;
+        }
+    }
+    if (json)
+    {
+        file << "]" << endl;
+    }
+    return true;
+}
+
+// Renders every part up to maxLevel offscreen in each of its render paths and vertex formats, and
+// writes the generation, upload and draw times of each one to the file. Returns false if anything failed
+bool RunBenchmark(int width, int height, int maxLevel, const string &filename)
+{
+    GLuint framebuffer, renderbuffer, invocations = 0;
+    GLuint queries[BENCHMARK_FRAMES];
+    CreateOffscreenTarget(width, height, &framebuffer, &renderbuffer);
+    glGenQueries(BENCHMARK_FRAMES, queries);
+    if (HasExtension("GL_ARB_pipeline_statistics_query"))
+    {
+        glGenQueries(1, &invocations);
+    }
+
+    // the adaptive spiral is sampled for the offscreen target, not the hidden window
+    framebufferPixels = max(width, height);
+    const int modes[] = { NUMBER_OF_SQUARE_MODES, NUMBER_OF_SPIRAL_MODES, NUMBER_OF_SIERPINSKI_MODES };
+    vector<BenchmarkResult> results;
+    bool succeeded = true;
+    for (int part = 1; part <= NUMBER_OF_PARTS; part++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            for (int mode = 1; mode <= modes[part - 1]; mode++)
+            {
+                int variant = mode;
+                int formats = GeometryHasVertexArrays(part, variant) ? NUMBER_OF_VERTEX_FORMATS : 1;
+                for (int format = 1; format <= formats; format++)
+                {
+                    if (format == 4 && !GeometryHasPalette(part, variant))
+                    {
+                        continue;
+                    }
+                    BenchmarkResult result;
+                    result.part = part;
+                    result.level = level;
+                    result.variant = variant;
+                    result.format = format;
+                    if (!BenchmarkGeometry(&result, width, height, queries, invocations))
+                    {
+                        succeeded = false;
+                        continue;
+                    }
+                    cout << "Part " << part << " level " << level << " mode " << variant << " format " << format
+                         << ": " << result.drawTime << " ms per frame, " << result.framesPerSecond << " fps" << endl;
+                    results.push_back(result);
+                }
+            }
+        }
+    }
+
+    glDeleteQueries(BENCHMARK_FRAMES, queries);
+    glDeleteQueries(1, &invocations);
+    DestroyOffscreenTarget(framebuffer, renderbuffer);
+    return WriteBenchmarkResults(results, filename) && succeeded;
+}
+
+// --------------------------------------------------------------------------
+// Frame pacing: continuous rendering with an optional frame rate limit, and a
+// histogram of the time between buffer swaps
+
+const double PACING_BUCKET_MS = 0.1;    // width of a histogram bucket
+const int PACING_BUCKETS = 1000;        // up to 100 ms, longer frames go in the last bucket
+const double PACING_SPIN_SECONDS = 0.002;   // end of a wait spent spinning, since sleeping overshoots
+
+// By default the window only draws when an event arrives. Continuously it draws as fast as the swap
+// interval and the frame rate limit allow, polling for events between frames
+struct FramePacing
+{
+    bool continuous;
+    bool vsync;                 // swap interval of one instead of zero
+    double targetFps;           // frame rate limit, zero for none
+    double nextFrame;           // glfwGetTime() at which the limiter lets the next frame start
+    double lastSwap;            // negative until the first frame is recorded
+    unsigned long counts[PACING_BUCKETS];
+    unsigned long frames;
+    unsigned long frameLimit;   // frames to draw continuously before closing the window, zero for no limit
+    double total;               // all in milliseconds
+    double longest;
+
+    FramePacing() : continuous(false), vsync(true), targetFps(0.0), nextFrame(0.0), lastSwap(-1.0), frames(0),
+        frameLimit(0), total(0.0), longest(0.0)
+    {
+        fill(counts, counts + PACING_BUCKETS, 0);
+    }
+};
+FramePacing pacing;
+
+// Empties the histogram, when the way frames are paced changes
+void ResetFramePacing(FramePacing *pacing)
+{
+    fill(pacing->counts, pacing->counts + PACING_BUCKETS, 0);
+    pacing->frames = 0;
+    pacing->lastSwap = -1.0;
+    pacing->total = 0.0;
+    pacing->longest = 0.0;
+}
+
+// Called after every buffer swap, adds the time since the previous swap to the histogram. Only the
+// frames of continuous rendering are counted, waiting for events says nothing about pacing
+void RecordFramePacing(FramePacing *pacing)
+{
+    double now = glfwGetTime();
+    if (!pacing->continuous)
+    {
+        pacing->lastSwap = -1.0;
+        return;
+    }
+    if (pacing->lastSwap >= 0.0)
+    {
+        double interval = (now - pacing->lastSwap) * 1000.0;
+        pacing->counts[min((int)(interval / PACING_BUCKET_MS), PACING_BUCKETS - 1)]++;
+        pacing->frames++;
+        pacing->total += interval;
+        pacing->longest = max(pacing->longest, interval);
+    }
+    pacing->lastSwap = now;
+}
+
+// Upper edge of the bucket holding the given fraction of the frames, in milliseconds
+double FramePercentile(const FramePacing *pacing, double fraction)
+{
+    unsigned long wanted = (unsigned long)ceil(fraction * pacing->frames);
+    unsigned long counted = 0;
+    for (int i = 0; i < PACING_BUCKETS; i++)
+    {
+        counted += pacing->counts[i];
+        if (counted >= wanted)
+        {
+            return min((i + 1) * PACING_BUCKET_MS, pacing->longest);
+        }
+    }
+    return pacing->longest;
+}
+
+// Prints the percentiles of the time between swaps and a histogram of at most ten rows
+void PrintFramePacing(const FramePacing *pacing)
+{
+    if (pacing->frames == 0)
+    {
+        return;
+    }
+    cout << "Frame pacing over " << pacing->frames << " frames (vsync " << (pacing->vsync ? "on" : "off");
+    if (pacing->targetFps > 0.0)
+    {
+        cout << ", limited to " << pacing->targetFps << " fps";
+    }
+    cout << "): mean " << pacing->total / pacing->frames << " ms (" << 1000.0 * pacing->frames / pacing->total
+         << " fps), p50 " << FramePercentile(pacing, 0.5) << " ms, p99 " << FramePercentile(pacing, 0.99)
+         << " ms, max " << pacing->longest << " ms" << endl;
+
+    int first = 0;
+    int last = PACING_BUCKETS - 1;
+    while (pacing->counts[first] == 0)
+    {
+        first++;
+    }
+    while (pacing->counts[last] == 0)
+    {
+        last--;
+    }
+    const int ROWS = 10;
+    const int BAR = 50;
+    int width = (last - first) / ROWS + 1;
+    for (int row = first; row <= last; row += width)
+    {
+        unsigned long frames = 0;
+        for (int i = row; i < min(row + width, PACING_BUCKETS); i++)
+        {
+            frames += pacing->counts[i];
+        }
+        cout << "  " << row * PACING_BUCKET_MS << " - " << (row + width) * PACING_BUCKET_MS << " ms: "
+             << string((size_t)(BAR * frames / pacing->frames), '#') << " " << frames << endl;
+    }
+}
+
+// Applies the swap interval of the pacing to the current context
+void ApplySwapInterval(const FramePacing *pacing)
+{
+    glfwSwapInterval(pacing->vsync ? 1 : 0);
+}
 
-    return !CheckGLErrors();
+// Holds the next frame back until the frame rate limit allows it. Waits sleep for most of the time
+// and spin for the last stretch, so frames start within microseconds of their deadline. A limiter that
+// fell more than a frame behind starts afresh instead of rushing frames to catch up
+void WaitForNextFrame(FramePacing *pacing)
+{
+    if (pacing->targetFps <= 0.0)
+    {
+        return;
+    }
+    double period = 1.0 / pacing->targetFps;
+    double now = glfwGetTime();
+    pacing->nextFrame += period;
+    if (pacing->nextFrame < now - period)
+    {
+        pacing->nextFrame = now;
+    }
+    double remaining = pacing->nextFrame - now;
+    if (remaining > PACING_SPIN_SECONDS)
+    {
+        this_thread::sleep_for(chrono::duration<double>(remaining - PACING_SPIN_SECONDS));
+    }
+    while (glfwGetTime() < pacing->nextFrame)
+    {
+        this_thread::yield();
+    }
 }
 
 // --------------------------------------------------------------------------
@@ -619,37 +3962,55 @@ void ErrorCallback(int error, const char* description)
     cout << description << endl;
 }
 
-// Function that depending on what's the value of PART initializes a different shape
+// Function that depending on what's the value of PART and LEVEL displays a different shape. Shapes
+// resident in the geometry cache or pregenerated in a mesh file are shown at once, others are
+// generated on the builder thread while the previous scene keeps being drawn
 void initializeTheShape()
 {
-    if (PART == 1)
+    latency.requestTime = glfwGetTime();
+    int variant = GeometryVariant(PART);
+    int format = GeometryFormat(PART, variant);
+    int index;
+    if (AcquireGeometry(&cache, PART, LEVEL, &geometry, &renderMode))
     {
-        DestroyGeometry(&geometry);
-        renderMode = GL_TRIANGLES;
-        if (!InitializeSquareAndDiamond(&geometry))
-        {
-            cout << "Program failed to intialize geometry!" << endl;
-        }
+        CancelGeometryBuild(&builder);
     }
-    else if (PART == 2) {
-        //DestroyGeometry(&geometry);
-        renderMode = GL_LINES;
-        if (!InitializeSpirals(&geometry))
-        {
-            cout << "Program failed to intialize spirals!" << endl;
-        }
-
+    else if ((index = InsertMeshFile(&cache, PART, LEVEL, variant, format)) >= 0)
+    {
+        // mapping a pregenerated mesh is quick enough to upload it right away
+        geometry = DisplayCacheEntry(&cache, index, LEVEL, &renderMode);
+        CancelGeometryBuild(&builder);
     }
-    else if (PART == 3) {
-        DestroyGeometry(&geometry);
-        renderMode = GL_TRIANGLES;
-        if (!InitializeSierpinksiTriangle(&geometry))
-        {
-            cout << "Program failed to intialize sierpinski triangles!" << endl;
-        }
+    else if ((index = SubdivideGrowableEntry(&cache, PART, LEVEL, variant, format)) >= 0)
+    {
+        // so is one transform feedback pass per level
+        geometry = DisplayCacheEntry(&cache, index, LEVEL, &renderMode);
+        CancelGeometryBuild(&builder);
+    }
+    else
+    {
+        // a shape that grows only needs the levels above the deepest one cached below it
+        index = FindGrowableEntry(&cache, PART, LEVEL, variant, format);
+        RequestGeometryBuild(&builder, PART, LEVEL, variant, format, index >= 0 ? cache.entries[index].level : 0);
     }
 }
 
+// Follows the framebuffer size with the viewport and samples the adaptive spiral again for it
+void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
+{
+    glViewport(0, 0, width, height);
+    if (width == 0 || height == 0)
+    {
+        // minimized
+        return;
+    }
+    framebufferPixels = max(width, height);
+    DropResizedGeometry(&cache, geometry);
+    if (!galleryMode && PART == 2 && SPIRAL_MODE == 3)
+    {
+        initializeTheShape();
+    }
+}
 
 // Handles keyboard input events, ignoring non-GLFW_PRESS actions and keys that do not trigger rendering of shapes
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -657,7 +4018,9 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     // Map the keys that will produce a change in the program
     int inputKeys [] = {
         GLFW_KEY_A, GLFW_KEY_B, GLFW_KEY_C, GLFW_KEY_1, GLFW_KEY_2, 
-        GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5, GLFW_KEY_6
+        GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5, GLFW_KEY_6, GLFW_KEY_S,
+        GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_M, GLFW_KEY_T, GLFW_KEY_F, GLFW_KEY_G,
+        GLFW_KEY_I, GLFW_KEY_R, GLFW_KEY_P, GLFW_KEY_V
     };
     bool keyFound = find(begin(inputKeys), end(inputKeys), key) != end(inputKeys);
 
@@ -674,6 +4037,85 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         {
             glfwSetWindowShouldClose(window, GL_TRUE);
         }
+        else if (key == GLFW_KEY_S)
+        {
+            PrintCacheStats(&cache);
+            PrintSceneLatency(&latency, &builder);
+            return;
+        }
+        else if (key == GLFW_KEY_T)
+        {
+            TimeScene(&geometry, &shader, renderMode);
+            return;
+        }
+        else if (key == GLFW_KEY_I)
+        {
+            PrintFrameStats(&frameStats);
+            PrintFramePacing(&pacing);
+            return;
+        }
+        else if (key == GLFW_KEY_P)
+        {
+            PrintFramePacing(&pacing);
+            pacing.continuous = !pacing.continuous;
+            pacing.nextFrame = glfwGetTime();
+            ResetFramePacing(&pacing);
+            cout << (pacing.continuous ? "Drawing continuously" : "Drawing only when events arrive") << endl;
+            return;
+        }
+        else if (key == GLFW_KEY_V)
+        {
+            PrintFramePacing(&pacing);
+            pacing.vsync = !pacing.vsync;
+            ApplySwapInterval(&pacing);
+            ResetFramePacing(&pacing);
+            cout << "Vsync " << (pacing.vsync ? "on" : "off") << endl;
+            return;
+        }
+        else if (key == GLFW_KEY_R)
+        {
+            if (frameStats.trace.is_open())
+            {
+                StopFrameTrace(&frameStats);
+                cout << "Frame trace written to " << frameStats.traceFilename << endl;
+            }
+            else if (StartFrameTrace(&frameStats))
+            {
+                cout << "Writing a row per frame to " << frameStats.traceFilename << endl;
+            }
+            return;
+        }
+        else if (key == GLFW_KEY_G)
+        {
+            galleryMode = !galleryMode;
+            if (galleryMode && gallery.tiles == 0 && !BuildGallery(&gallery, NUMBER_OF_LEVELS))
+            {
+                galleryMode = false;
+            }
+            cout << (galleryMode ? "Gallery of every part and level" : "Single shape") << endl;
+            return;
+        }
+        else if (key == GLFW_KEY_M && PART == 1)
+        {
+            SQUARE_MODE = SQUARE_MODE % NUMBER_OF_SQUARE_MODES + 1;
+            cout << "Square and diamond drawn " << (SQUARE_MODE == 2 ? "from their corners through an index buffer" : "from one vertex array") << endl;
+        }
+        else if (key == GLFW_KEY_M && PART == 2)
+        {
+            SPIRAL_MODE = SPIRAL_MODE % NUMBER_OF_SPIRAL_MODES + 1;
+            cout << "Spiral colours " << (SPIRAL_MODE == 2 ? "computed in the vertex shader" : "from a colour buffer")
+                 << (SPIRAL_MODE == 3 ? ", samples spaced for the framebuffer size" : "") << endl;
+        }
+        else if (key == GLFW_KEY_M && PART == 3)
+        {
+            SIERPINSKI_MODE = SIERPINSKI_MODE % NUMBER_OF_SIERPINSKI_MODES + 1;
+            cout << "Sierpinski triangle drawn " << SierpinskiModeName(SIERPINSKI_MODE) << endl;
+        }
+        else if (key == GLFW_KEY_F)
+        {
+            VERTEX_FORMAT = VERTEX_FORMAT % NUMBER_OF_VERTEX_FORMATS + 1;
+            cout << "Vertex arrays stored as " << VertexFormatName(VERTEX_FORMAT) << endl;
+        }
             
         else if (key == GLFW_KEY_A)
         {
@@ -711,6 +4153,14 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         {
             LEVEL = 6;
         }
+        else if (key == GLFW_KEY_UP)
+        {
+            LEVEL++;
+        }
+        else if (key == GLFW_KEY_DOWN && LEVEL > 1)
+        {
+            LEVEL--;
+        }
         initializeTheShape();
     }
 }
@@ -721,6 +4171,157 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
 int main(int argc, char *argv[])
 {   
+    // read the command line options
+    bool compareSierpinski = false;
+    bool compareGallery = false;
+    bool compareCompute = false;
+    bool compareSubdivision = false;
+    bool comparePalette = false;
+    bool compareBuilder = false;
+    string benchmarkFile;
+    int contextApi = 0;         // GLFW context creation API, zero for the platform default
+    string pregenerateDirectory;
+    int meshLevels = NUMBER_OF_LEVELS;
+    bool traceFrames = false;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--warmup")
+        {
+            cache.warmupNext = 0;
+        }
+        else if (option == "--compare-sierpinski")
+        {
+            compareSierpinski = true;
+        }
+        else if (option == "--compare-gallery")
+        {
+            compareGallery = true;
+        }
+        else if (option == "--compute-geometry")
+        {
+            computeGeometry.enabled = true;
+        }
+        else if (option == "--compare-compute")
+        {
+            compareCompute = true;
+            computeGeometry.enabled = true;
+        }
+        else if (option == "--gpu-subdivision")
+        {
+            gpuSubdivision = true;
+        }
+        else if (option == "--compare-subdivision")
+        {
+            compareSubdivision = true;
+            gpuSubdivision = true;
+        }
+        else if (option == "--compare-palette")
+        {
+            comparePalette = true;
+        }
+        else if (option == "--compare-builder")
+        {
+            compareBuilder = true;
+        }
+        else if (option.compare(0, 12, "--benchmark=") == 0)
+        {
+            benchmarkFile = option.substr(12);
+        }
+        else if (option == "--context-api=egl")
+        {
+            contextApi = GLFW_EGL_CONTEXT_API;
+        }
+        else if (option == "--context-api=osmesa")
+        {
+            contextApi = GLFW_OSMESA_CONTEXT_API;
+        }
+        else if (option.compare(0, 15, "--shader-cache=") == 0)
+        {
+            shaderCacheDirectory = option.substr(15);
+        }
+        else if (option.compare(0, 21, "--pregenerate-meshes=") == 0)
+        {
+            pregenerateDirectory = option.substr(21);
+        }
+        else if (option.compare(0, 14, "--mesh-levels=") == 0)
+        {
+            meshLevels = atoi(option.substr(14).c_str());
+        }
+        else if (option.compare(0, 17, "--mesh-directory=") == 0)
+        {
+            meshDirectory = option.substr(17);
+        }
+        else if (option == "--geometry-sink=vector")
+        {
+            mappedGeometrySink = false;
+        }
+        else if (option == "--geometry-sink=mapped")
+        {
+            mappedGeometrySink = true;
+        }
+        else if (option.compare(0, 15, "--cache-budget=") == 0)
+        {
+            cache.budgetBytes = (GLsizeiptr)(atof(option.substr(15).c_str()) * 1024 * 1024);
+        }
+        else if (option.compare(0, 26, "--sierpinski-memory-limit=") == 0)
+        {
+            sierpinskiMemoryLimit = (long long)(atof(option.substr(26).c_str()) * 1024 * 1024);
+        }
+        else if (option.compare(0, 16, "--spiral-pixels=") == 0)
+        {
+            spiralSegmentPixels = atof(option.substr(16).c_str());
+        }
+        else if (option == "--continuous")
+        {
+            pacing.continuous = true;
+        }
+        else if (option == "--vsync=on" || option == "--vsync=off")
+        {
+            pacing.vsync = option == "--vsync=on";
+        }
+        else if (option.compare(0, 13, "--target-fps=") == 0)
+        {
+            pacing.targetFps = atof(option.substr(13).c_str());
+        }
+        else if (option.compare(0, 9, "--frames=") == 0)
+        {
+            pacing.frameLimit = strtoul(option.substr(9).c_str(), 0, 10);
+            pacing.continuous = true;
+        }
+        else if (option.compare(0, 8, "--trace=") == 0)
+        {
+            frameStats.traceFilename = option.substr(8);
+            traceFrames = true;
+        }
+        else
+        {
+            cout << "Unknown option " << option << endl;
+            cout << "Usage: main [--warmup] [--cache-budget=<megabytes>] [--sierpinski-memory-limit=<megabytes>]"
+                 << " [--compare-sierpinski] [--compare-gallery] [--benchmark=<file.csv|file.json>] [--context-api=egl|osmesa]"
+                 << " [--shader-cache=<directory>] [--pregenerate-meshes=<directory>] [--mesh-levels=<level>]"
+                 << " [--mesh-directory=<directory>] [--geometry-sink=mapped|vector] [--trace=<file.csv>]"
+                 << " [--continuous] [--vsync=on|off] [--target-fps=<fps>] [--frames=<count>]"
+                 << " [--spiral-pixels=<pixels>] [--compute-geometry] [--compare-compute]"
+                 << " [--gpu-subdivision] [--compare-subdivision] [--compare-palette] [--compare-builder]" << endl;
+            return -1;
+        }
+    }
+
+    // generating the mesh files only needs the CPU, so no window is created
+    if (!pregenerateDirectory.empty())
+    {
+        return PregenerateMeshes(pregenerateDirectory, meshLevels) ? 0 : 1;
+    }
+
+    // without a display the null platform of GLFW 3.4 can still create EGL or OSMesa contexts
+#ifdef GLFW_PLATFORM_NULL
+    if (contextApi != 0)
+    {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+#endif
+
     // initialize the GLFW windowing system
     if (!glfwInit()) {
         cout << "ERROR: GLFW failed to initilize, TERMINATING" << endl;
@@ -730,51 +4331,230 @@ int main(int argc, char *argv[])
 
     // By default render triangles
     renderMode = GL_TRIANGLES;
-    // attempt to create a window with an OpenGL 4.1 core profile context
+    // attempt to create a window with an OpenGL 4.1 core profile context, or 4.3 for compute shaders
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, computeGeometry.enabled ? 3 : 1);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef RELEASE
+    // drivers only have to produce debug output in debug contexts
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
+    if (contextApi != 0)
+    {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
+    }
+    bool headless = compareSierpinski || compareGallery || compareCompute || compareSubdivision
+        || comparePalette || compareBuilder || !benchmarkFile.empty();
+    if (headless)
+    {
+        // the comparison and the benchmark render offscreen, so the window is never shown
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    }
     GLFWwindow* window;
     window = glfwCreateWindow(512, 512, "CPSC 453 Assignment #1 Maria Diaz", 0, 0);
+    if (!window && computeGeometry.enabled)
+    {
+        // macOS and older drivers stop at OpenGL 4.1, the shapes are then generated on the CPU
+        cout << "No OpenGL 4.3 context for compute shaders, generating the shapes on the CPU" << endl;
+        computeGeometry.enabled = false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        window = glfwCreateWindow(512, 512, "CPSC 453 Assignment #1 Maria Diaz", 0, 0);
+    }
     if (!window) {
         cout << "Program failed to create GLFW window, TERMINATING" << endl;
         glfwTerminate();
         return -1;
     }
 
-    // set keyboard callback function and make our context current (active)
+    // set keyboard and resize callback functions and make our context current (active)
     glfwSetKeyCallback(window, KeyCallback);
+    glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
     glfwMakeContextCurrent(window);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    framebufferPixels = max(framebufferWidth, framebufferHeight);
     // query and print out information about our OpenGL environment
     QueryGLVersion();
+#ifndef RELEASE
+    debugOutput = EnableDebugOutput();
+    pollFrameErrors = !debugOutput;
+    cout << "OpenGL errors " << (debugOutput ? "reported by the KHR_debug callback" : "polled after every frame") << endl;
+#endif
 
     // call function to load and compile shader programs
-    if (!InitializeShaders(&shader)) {
+    double shaderStart = glfwGetTime();
+    if (!InitializeShaders(&shader, "vertex.glsl", "fragment.glsl")
+        || !InitializeShaders(&instancedShader, "vertex_instanced.glsl", "fragment.glsl")
+        || !InitializeShaders(&proceduralShader, "vertex_procedural.glsl", "fragment.glsl")
+        || !InitializeShaders(&spiralShader, "vertex_spiral.glsl", "fragment.glsl")
+        || !InitializeShaders(&flatShader, "vertex_flat.glsl", "fragment_flat.glsl")
+        || !InitializeShaders(&galleryShader, "vertex_gallery.glsl", "fragment.glsl")
+        || !InitializeShaders(&paletteShader, "vertex_palette.glsl", "fragment.glsl")) {
         cout << "Program could not initialize shaders, TERMINATING" << endl;
         return -1;
     }
-    // By default initializes the square and diamond on level 1
-    if (!InitializeSquareAndDiamond(&geometry))
+    SetupProceduralSierpinski(&proceduralShader);
+    paletteBuffer = SetupPalette(&paletteShader);
+    if (computeGeometry.enabled)
+    {
+        computeGeometry.enabled = InitializeComputeGeometry(&computeGeometry);
+        cout << (computeGeometry.enabled ? "Spirals and Sierpinski triangles generated by compute shaders"
+                                         : "Compute shaders unavailable, generating the shapes on the CPU") << endl;
+    }
+    if (gpuSubdivision)
+    {
+        vector<const GLchar *> varyings;
+        varyings.push_back("Position");
+        varyings.push_back("Colour");
+        gpuSubdivision = InitializeFeedbackShader(&subdivisionShader, "vertex_subdivide.glsl", varyings);
+        cout << (gpuSubdivision ? "Sierpinski triangles step up a level with transform feedback"
+                                : "Transform feedback program unavailable, stepping up levels on the CPU") << endl;
+    }
+
+    // the clock of GLFW starts when it is initialized, so this includes creating the window
+    double shaderEnd = glfwGetTime();
+    cout << "Shaders ready in " << (shaderEnd - shaderStart) * 1000.0 << " ms with " << programsFromCache
+         << " of " << programsRequested << " programs from the binary cache, " << shaderEnd * 1000.0
+         << " ms after startup" << endl;
+
+    if (headless)
+    {
+        bool passed = true;
+        if (compareSierpinski)
+        {
+            passed = CompareSierpinskiModes(512, 512);
+        }
+        if (compareGallery)
+        {
+            passed = CompareGalleryDraws(512, 512, NUMBER_OF_LEVELS) && passed;
+        }
+        if (compareCompute)
+        {
+            passed = computeGeometry.enabled && CompareComputeGeometry(meshLevels) && passed;
+        }
+        if (compareSubdivision)
+        {
+            passed = gpuSubdivision && CompareSubdivision(meshLevels) && passed;
+        }
+        if (comparePalette)
+        {
+            passed = ComparePalette(512, 512, meshLevels) && passed;
+        }
+        if (compareBuilder)
+        {
+            passed = CompareBuilderHandOff(window, 512, 512, NUMBER_OF_LEVELS) && passed;
+        }
+        if (!benchmarkFile.empty())
+        {
+            passed = RunBenchmark(512, 512, meshLevels, benchmarkFile) && passed;
+        }
+        DestroyShaders(&shader);
+        DestroyShaders(&instancedShader);
+        DestroyShaders(&proceduralShader);
+        DestroyShaders(&spiralShader);
+        DestroyShaders(&flatShader);
+        DestroyShaders(&galleryShader);
+        DestroyShaders(&paletteShader);
+        DestroyPalette();
+        DestroyShaders(&computeGeometry.spiral);
+        DestroyShaders(&computeGeometry.sierpinski);
+        DestroyShaders(&subdivisionShader);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return passed ? 0 : 1;
+    }
+    // a hidden window sharing the buffers of the main one lets the builder thread generate shapes
+    // straight into mapped buffers, without it shapes are generated into vectors and uploaded here
+    if (mappedGeometrySink)
     {
-        cout << "Program failed to intialize geometry!" << endl;
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        builder.context = glfwCreateWindow(1, 1, "Geometry builder", 0, window);
     }
 
+    // the timer queries only exist for the frames of the window
+    StartFrameStats(&frameStats);
+    ApplySwapInterval(&pacing);
+    pacing.nextFrame = glfwGetTime();
+    if (traceFrames)
+    {
+        StartFrameTrace(&frameStats);
+    }
+
+    // By default initializes the square and diamond on level 1
+    StartGeometryBuilder(&builder);
+    initializeTheShape();
+
     while(!glfwWindowShouldClose(window))
     {
+        BeginFrameStats(&frameStats);
+
+        // Swap in the requested shape once the builder thread has generated it
+        AdoptFinishedGeometry(&builder, &cache, &latency);
+
         // Draw scene
-        RenderScene(&geometry, &shader, renderMode);
+        if (galleryMode)
+        {
+            RenderGallery(&gallery);
+        }
+        else
+        {
+            RenderScene(&geometry, &shader, renderMode);
+        }
 
         // scene is rendered to the back buffer, so swap to front for display
         glfwSwapBuffers(window);
+        RecordSceneLatency(&latency, &builder);
+        EndFrameStats(&frameStats);
+        RecordFramePacing(&pacing);
+        if (pacing.frameLimit > 0 && pacing.frames >= pacing.frameLimit)
+        {
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
 
-        // sleep until next event before drawing again
-        glfwWaitEvents();
+        // keep prebuilding shapes between events while warming up the cache, but not while
+        // the displayed scene is about to be replaced since warming may evict it. Drawing
+        // continuously only waits for the frame rate limit. Otherwise sleep until next event,
+        // or until the builder thread finishes, before drawing again
+        if (!GeometryBuildPending(&builder) && WarmUpGeometryCache(&cache))
+        {
+            glfwPollEvents();
+        }
+        else if (pacing.continuous)
+        {
+            WaitForNextFrame(&pacing);
+            glfwPollEvents();
+        }
+        else
+        {
+            glfwWaitEvents();
+        }
     }
 
     // clean up allocated resources before exit
-    DestroyGeometry(&geometry);
+    StopGeometryBuilder(&builder);
+    if (builder.context != 0)
+    {
+        glfwDestroyWindow(builder.context);
+    }
+    PrintCacheStats(&cache);
+    PrintSceneLatency(&latency, &builder);
+    PrintFrameStats(&frameStats);
+    PrintFramePacing(&pacing);
+    DestroyFrameStats(&frameStats);
+    DestroyGeometryCache(&cache);
+    DestroyGallery(&gallery);
     DestroyShaders(&shader);
+    DestroyShaders(&instancedShader);
+    DestroyShaders(&proceduralShader);
+    DestroyShaders(&spiralShader);
+    DestroyShaders(&flatShader);
+    DestroyShaders(&galleryShader);
+    DestroyShaders(&paletteShader);
+    DestroyPalette();
+    DestroyShaders(&computeGeometry.spiral);
+    DestroyShaders(&computeGeometry.sierpinski);
+    DestroyShaders(&subdivisionShader);
     glfwDestroyWindow(window);
     glfwTerminate();  
 
@@ -805,6 +4585,12 @@ bool CheckGLErrors()
     bool error = false;
     for (GLenum flag = glGetError(); flag != GL_NO_ERROR; flag = glGetError())
     {
+        // the debug output callback has already described it
+        error = true;
+        if (debugOutput)
+        {
+            continue;
+        }
         cout << "OpenGL ERROR:  ";
         switch (flag) {
         case GL_INVALID_ENUM:
@@ -820,24 +4606,98 @@ bool CheckGLErrors()
         default:
             cout << "[unknown error code]" << endl;
         }
-        error = true;
     }
     return error;
 }
 
+// Checks for errors after drawing a frame. glGetError waits for the driver to catch up with the
+// commands sent so far on many drivers, so frames only poll it without the debug output callback,
+// and release builds leave it out altogether. Errors while building geometry are still polled
+void CheckFrameErrors()
+{
+#ifndef RELEASE
+    if (pollFrameErrors)
+    {
+        CheckGLErrors();
+    }
+#endif
+}
+
+const char *DebugSourceName(GLenum source)
+{
+    switch (source) {
+    case GL_DEBUG_SOURCE_API:               return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:     return "window system";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER:   return "shader compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:       return "third party";
+    case GL_DEBUG_SOURCE_APPLICATION:       return "application";
+    default:                                return "other source";
+    }
+}
+
+const char *DebugTypeName(GLenum type)
+{
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR:               return "ERROR";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behaviour";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behaviour";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+    default:                                return "other";
+    }
+}
+
+const char *DebugSeverityName(GLenum severity)
+{
+    switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH:            return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM:          return "medium";
+    case GL_DEBUG_SEVERITY_LOW:             return "low";
+    default:                                return "notification";
+    }
+}
+
+// reports a message of the debug output, whichever thread the driver calls from
+void APIENTRY DebugOutputCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+    const GLchar *message, const void *userParam)
+{
+    lock_guard<mutex> guard(debugOutputLock);
+    cout << "OpenGL " << DebugTypeName(type) << " (" << DebugSeverityName(severity) << " severity, "
+         << DebugSourceName(source) << " " << id << "): " << message << endl;
+}
+
+// Has the current context report errors and warnings through DebugOutputCallback() as they happen,
+// without synchronous output so the driver need not wait for them. Returns false without KHR_debug
+bool EnableDebugOutput()
+{
+    DebugMessageCallbackFunction callback = (DebugMessageCallbackFunction)glfwGetProcAddress("glDebugMessageCallback");
+    DebugMessageControlFunction control = (DebugMessageControlFunction)glfwGetProcAddress("glDebugMessageControl");
+    if (!HasExtension("GL_KHR_debug") || callback == 0 || control == 0)
+    {
+        return false;
+    }
+    callback(DebugOutputCallback, 0);
+
+    // notifications only tell where buffers are placed and the like
+    control(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, 0, GL_FALSE);
+    glEnable(GL_DEBUG_OUTPUT);
+    return true;
+}
+
 // --------------------------------------------------------------------------
 // OpenGL shader support functions
 
-// reads a text file with the given name into a string
+// reads a text file with the given name into a string, in one read of the whole file
 string LoadSource(const string &filename)
 {
     string source;
 
-    ifstream input(filename.c_str());
+    ifstream input(filename.c_str(), ios::binary);
     if (input) {
-        copy(istreambuf_iterator<char>(input),
-             istreambuf_iterator<char>(),
-             back_inserter(source));
+        input.seekg(0, ios::end);
+        source.resize((size_t)input.tellg());
+        input.seekg(0, ios::beg);
+        input.read(&source[0], source.size());
         input.close();
     }
     else {
@@ -876,8 +4736,9 @@ GLuint CompileShader(GLenum shaderType, const string &source)
     return shaderObject;
 }
 
-// creates and returns a program object linked from vertex and fragment shaders
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
+// creates and returns a program object linked from vertex and fragment shaders, with the given
+// varyings captured into separate buffers by transform feedback
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, const vector<const GLchar *> &feedbackVaryings)
 {
     // allocate program object name
     GLuint programObject = glCreateProgram();
@@ -885,6 +4746,13 @@ GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
     // attach provided shader objects to this program
     if (vertexShader)   glAttachShader(programObject, vertexShader);
     if (fragmentShader) glAttachShader(programObject, fragmentShader);
+    if (!feedbackVaryings.empty())
+    {
+        glTransformFeedbackVaryings(programObject, feedbackVaryings.size(), feedbackVaryings.data(), GL_SEPARATE_ATTRIBS);
+    }
+
+    // keep the linked binary available for the program binary cache
+    glProgramParameteri(programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     // try linking the program with given attachments
     glLinkProgram(programObject);
@@ -905,5 +4773,103 @@ GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
     return programObject;
 }
 
+// --------------------------------------------------------------------------
+// Program binary cache: each file holds a header followed by the binary returned by
+// glGetProgramBinary. The key is a hash of the sources and of the driver that linked them
+
+struct ProgramBinaryHeader
+{
+    char magic[4];
+    unsigned long long key;
+    GLenum format;
+    GLint length;
+};
+
+const char PROGRAM_BINARY_MAGIC[4] = { 'P', 'B', 'I', 'N' };
+
+// FNV-1a hash of the text, continuing from the given hash (zero to start a new one)
+unsigned long long HashString(unsigned long long hash, const string &text)
+{
+    if (hash == 0)
+    {
+        hash = 14695981039346656037ULL;
+    }
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+    }
+    // separates the strings, so that moving text from one to the next changes the hash
+    return (hash ^ 0xff) * 1099511628211ULL;
+}
+
+// Creates a program from the cached binary, returning zero if there is no binary for this key
+// or the driver rejects it, in which case the caller compiles the sources
+GLuint LoadProgramBinary(const string &filename, unsigned long long key)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    ifstream input(filename.c_str(), ios::binary);
+    if (formats == 0 || !input)
+    {
+        return 0;
+    }
+
+    ProgramBinaryHeader header;
+    input.read((char *)&header, sizeof(header));
+    if (!input || memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) != 0 || header.key != key || header.length <= 0)
+    {
+        return 0;
+    }
+    vector<char> binary(header.length);
+    input.read(binary.data(), binary.size());
+    if (!input)
+    {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), binary.size());
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Writes the binary of a linked program to the cache, creating the cache directory if needed
+void SaveProgramBinary(GLuint program, const string &filename, unsigned long long key)
+{
+    GLint status, formats = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (status == GL_FALSE || formats == 0)
+    {
+        return;
+    }
+
+    ProgramBinaryHeader header;
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+    header.key = key;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    vector<char> binary(header.length);
+    glGetProgramBinary(program, header.length, &header.length, &header.format, binary.data());
+    if (header.length <= 0)
+    {
+        return;
+    }
+
+    mkdir(shaderCacheDirectory.c_str(), 0755);
+    ofstream output(filename.c_str(), ios::binary | ios::trunc);
+    output.write((const char *)&header, sizeof(header));
+    output.write(binary.data(), header.length);
+    if (!output)
+    {
+        cout << "Could not write the program binary cache file " << filename << endl;
+    }
+}
+
 
 // ==========================================================================
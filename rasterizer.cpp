@@ -0,0 +1,432 @@
+// ==========================================================================
+// Software rasterizer for the vertex and colour arrays of the generators,
+// see rasterizer.h
+// ==========================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "geometry.h"
+#include "rasterizer.h"
+
+using namespace std;
+
+// --------------------------------------------------------------------------
+// Primitive setup
+
+// Triangle in pixel coordinates with its corners in counter clockwise order
+struct RasterTriangle
+{
+    float x[3], y[3];
+    float colour[3][3];
+    float inverseArea;
+    bool topLeft[3];            // edge opposite each corner owns the pixels exactly on it
+    int minX, minY, maxX, maxY; // covered pixels, clamped to the frame
+};
+
+// Line in pixel coordinates, with the start before the end along its major axis
+struct RasterLine
+{
+    float x[2], y[2];
+    float colour[2][3];
+    bool xMajor;
+    int minX, minY, maxX, maxY;
+};
+
+// Converts a position in normalized device coordinates to pixel coordinates, as the viewport does
+void viewportTransform(const RasterImage *image, const float *vertex, float *x, float *y)
+{
+    *x = (vertex[0] + 1.0f) * 0.5f * image->width;
+    *y = (vertex[1] + 1.0f) * 0.5f * image->height;
+}
+
+// Edge function of the edge from a to b, positive for points left of it
+inline float edgeFunction(float ax, float ay, float bx, float by, float px, float py)
+{
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+// Sets up a triangle, returns false when it has no area or lies outside the frame
+bool setupTriangle(const RasterImage *image, const float *vertices, const float *colours, RasterTriangle *t)
+{
+    float x[3], y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        viewportTransform(image, vertices + 2 * i, &x[i], &y[i]);
+    }
+    float area = edgeFunction(x[0], y[0], x[1], y[1], x[2], y[2]);
+    if (area == 0.0f)
+    {
+        return false;
+    }
+
+    // the generators wind their triangles both ways and nothing is culled, so make them all counter clockwise
+    int order[3] = {0, 1, 2};
+    if (area < 0.0f)
+    {
+        swap(order[1], order[2]);
+        area = -area;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        t->x[i] = x[order[i]];
+        t->y[i] = y[order[i]];
+        for (int c = 0; c < 3; c++)
+        {
+            t->colour[i][c] = colours[3 * order[i] + c];
+        }
+    }
+    t->inverseArea = 1.0f / area;
+
+    // top-left fill rule, so that pixels on an edge shared by two triangles are drawn only once
+    for (int i = 0; i < 3; i++)
+    {
+        float dx = t->x[(i + 2) % 3] - t->x[(i + 1) % 3];
+        float dy = t->y[(i + 2) % 3] - t->y[(i + 1) % 3];
+        t->topLeft[i] = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+    }
+
+    t->minX = max(0, (int)floor(min(min(t->x[0], t->x[1]), t->x[2])));
+    t->minY = max(0, (int)floor(min(min(t->y[0], t->y[1]), t->y[2])));
+    t->maxX = min(image->width - 1, (int)ceil(max(max(t->x[0], t->x[1]), t->x[2])));
+    t->maxY = min(image->height - 1, (int)ceil(max(max(t->y[0], t->y[1]), t->y[2])));
+    return t->minX <= t->maxX && t->minY <= t->maxY;
+}
+
+// Sets up a line, returns false when it has no length or lies outside the frame
+bool setupLine(const RasterImage *image, const float *vertices, const float *colours, RasterLine *l)
+{
+    float x[2], y[2];
+    for (int i = 0; i < 2; i++)
+    {
+        viewportTransform(image, vertices + 2 * i, &x[i], &y[i]);
+    }
+    float dx = x[1] - x[0];
+    float dy = y[1] - y[0];
+    if (dx == 0.0f && dy == 0.0f)
+    {
+        return false;
+    }
+
+    l->xMajor = fabs(dx) >= fabs(dy);
+    int first = (l->xMajor ? dx : dy) < 0.0f ? 1 : 0;
+    for (int i = 0; i < 2; i++)
+    {
+        int j = i ^ first;
+        l->x[i] = x[j];
+        l->y[i] = y[j];
+        for (int c = 0; c < 3; c++)
+        {
+            l->colour[i][c] = colours[3 * j + c];
+        }
+    }
+
+    l->minX = max(0, (int)floor(min(x[0], x[1])));
+    l->minY = max(0, (int)floor(min(y[0], y[1])));
+    l->maxX = min(image->width - 1, (int)ceil(max(x[0], x[1])));
+    l->maxY = min(image->height - 1, (int)ceil(max(y[0], y[1])));
+    return l->minX <= l->maxX && l->minY <= l->maxY;
+}
+
+// --------------------------------------------------------------------------
+// Rasterization of one tile
+
+// Writes an interpolated colour to a pixel the way fragment.glsl outputs it
+inline void writePixel(unsigned char *pixel, float red, float green, float blue)
+{
+    pixel[0] = NormalizedByte(red);
+    pixel[1] = NormalizedByte(green);
+    pixel[2] = NormalizedByte(blue);
+}
+
+// Rasterizes the pixels from x to end of row y covered by a triangle, returns how many were covered
+int TriangleSpanScalar(RasterImage *image, const RasterTriangle &t, int x, int end, int y)
+{
+    int covered = 0;
+    float py = y + 0.5f;
+    unsigned char *pixel = &image->pixels[3 * ((long long)y * image->width + x)];
+    for (; x < end; x++, pixel += 3)
+    {
+        float px = x + 0.5f;
+        float w[3];
+        bool inside = true;
+        for (int i = 0; i < 3; i++)
+        {
+            w[i] = edgeFunction(t.x[(i + 1) % 3], t.y[(i + 1) % 3], t.x[(i + 2) % 3], t.y[(i + 2) % 3], px, py);
+            inside = inside && (w[i] > 0.0f || (w[i] == 0.0f && t.topLeft[i]));
+        }
+        if (!inside)
+        {
+            continue;
+        }
+        float colour[3];
+        for (int c = 0; c < 3; c++)
+        {
+            colour[c] = (w[0] * t.colour[0][c] + w[1] * t.colour[1][c] + w[2] * t.colour[2][c]) * t.inverseArea;
+        }
+        writePixel(pixel, colour[0], colour[1], colour[2]);
+        covered++;
+    }
+    return covered;
+}
+
+#if defined(__SSE2__)
+// Same as TriangleSpanScalar() for four pixels at a time, the remainder is left to it
+int TriangleSpanSSE(RasterImage *image, const RasterTriangle &t, int x, int end, int y)
+{
+    int covered = 0;
+    __m128 py = _mm_set1_ps(y + 0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    for (; x + 4 <= end; x += 4)
+    {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+        __m128 w[3];
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int i = 0; i < 3; i++)
+        {
+            int a = (i + 1) % 3;
+            int b = (i + 2) % 3;
+            __m128 ax = _mm_set1_ps(t.x[a]);
+            __m128 ay = _mm_set1_ps(t.y[a]);
+            w[i] = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(t.x[b] - t.x[a]), _mm_sub_ps(py, ay)),
+                              _mm_mul_ps(_mm_set1_ps(t.y[b] - t.y[a]), _mm_sub_ps(px, ax)));
+            __m128 edge = t.topLeft[i] ? _mm_cmpge_ps(w[i], zero) : _mm_cmpgt_ps(w[i], zero);
+            inside = _mm_and_ps(inside, edge);
+        }
+        int mask = _mm_movemask_ps(inside);
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // same rounding as NormalizedByte(), for all three channels of the four pixels
+        int bytes[3][4];
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 colour = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], _mm_set1_ps(t.colour[0][c])),
+                                                  _mm_mul_ps(w[1], _mm_set1_ps(t.colour[1][c]))),
+                                       _mm_mul_ps(w[2], _mm_set1_ps(t.colour[2][c])));
+            colour = _mm_mul_ps(colour, _mm_set1_ps(t.inverseArea));
+            colour = _mm_min_ps(_mm_max_ps(colour, zero), one);
+            colour = _mm_add_ps(_mm_mul_ps(colour, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+            _mm_storeu_si128((__m128i *)bytes[c], _mm_cvttps_epi32(colour));
+        }
+        unsigned char *pixel = &image->pixels[3 * ((long long)y * image->width + x)];
+        for (int i = 0; i < 4; i++)
+        {
+            if (mask & (1 << i))
+            {
+                pixel[3 * i] = (unsigned char)bytes[0][i];
+                pixel[3 * i + 1] = (unsigned char)bytes[1][i];
+                pixel[3 * i + 2] = (unsigned char)bytes[2][i];
+                covered++;
+            }
+        }
+    }
+    return covered + TriangleSpanScalar(image, t, x, end, y);
+}
+#endif
+
+// Rasterizes the part of a triangle inside the tile with the given pixel bounds
+long long RasterizeTriangle(RasterImage *image, const RasterTriangle &t, int x0, int y0, int x1, int y1)
+{
+    long long covered = 0;
+    int start = max(x0, t.minX);
+    int end = min(x1, t.maxX + 1);
+    for (int y = max(y0, t.minY); y < min(y1, t.maxY + 1); y++)
+    {
+#if defined(__SSE2__)
+        covered += TriangleSpanSSE(image, t, start, end, y);
+#else
+        covered += TriangleSpanScalar(image, t, start, end, y);
+#endif
+    }
+    return covered;
+}
+
+// Rasterizes the part of a line inside the tile with the given pixel bounds. Every column (or row when
+// the line is steeper than diagonal) whose centre the line crosses gets the one pixel the line passes,
+// the column of the end point is left to the line that continues from it
+long long RasterizeLine(RasterImage *image, const RasterLine &l, int x0, int y0, int x1, int y1)
+{
+    // step along the major axis, u, and find the pixel on the minor one, v
+    float u0 = l.xMajor ? l.x[0] : l.y[0];
+    float u1 = l.xMajor ? l.x[1] : l.y[1];
+    float v0 = l.xMajor ? l.y[0] : l.x[0];
+    float v1 = l.xMajor ? l.y[1] : l.x[1];
+    int tileStart = l.xMajor ? x0 : y0;
+    int tileEnd = l.xMajor ? x1 : y1;
+    int minorStart = l.xMajor ? y0 : x0;
+    int minorEnd = l.xMajor ? y1 : x1;
+
+    long long covered = 0;
+    float slope = (v1 - v0) / (u1 - u0);
+    int start = max(tileStart, (int)ceil(u0 - 0.5f));
+    int end = min(tileEnd, (int)ceil(u1 - 0.5f));
+    for (int u = start; u < end; u++)
+    {
+        float along = (u + 0.5f - u0) / (u1 - u0);
+        int v = (int)floor(v0 + (u + 0.5f - u0) * slope);
+        if (v < minorStart || v >= minorEnd)
+        {
+            continue;
+        }
+        int x = l.xMajor ? u : v;
+        int y = l.xMajor ? v : u;
+        float colour[3];
+        for (int c = 0; c < 3; c++)
+        {
+            colour[c] = l.colour[0][c] + (l.colour[1][c] - l.colour[0][c]) * along;
+        }
+        writePixel(&image->pixels[3 * ((long long)y * image->width + x)], colour[0], colour[1], colour[2]);
+        covered++;
+    }
+    return covered;
+}
+
+// --------------------------------------------------------------------------
+// Binning and drawing
+
+void ClearRasterImage(RasterImage *image, int width, int height, float red, float green, float blue)
+{
+    image->width = width;
+    image->height = height;
+    image->pixels.resize((size_t)width * height * 3);
+    unsigned char clear[3];
+    writePixel(clear, red, green, blue);
+    for (size_t i = 0; i < image->pixels.size(); i += 3)
+    {
+        image->pixels[i] = clear[0];
+        image->pixels[i + 1] = clear[1];
+        image->pixels[i + 2] = clear[2];
+    }
+}
+
+// Draws count vertices (two floats each) with their colours (three floats each) as GL_LINES or
+// GL_TRIANGLES into the image. The primitives are sorted into the tiles they cover, then the tiles are
+// rasterized on the given number of threads, each drawing its primitives in the order they came.
+// Returns the number of pixels written
+long long RasterizeArrays(RasterImage *image, bool lines, const float *vertices, const float *colours, int count, int threads)
+{
+    int tilesX = (image->width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    int tilesY = (image->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    vector<vector<int> > bins(tilesX * tilesY);
+
+    int corners = lines ? 2 : 3;
+    int primitives = count / corners;
+    vector<RasterTriangle> triangles(lines ? 0 : primitives);
+    vector<RasterLine> segments(lines ? primitives : 0);
+    for (int i = 0; i < primitives; i++)
+    {
+        const float *vertex = vertices + 2 * corners * i;
+        const float *colour = colours + 3 * corners * i;
+        int minX, minY, maxX, maxY;
+        if (lines)
+        {
+            RasterLine *l = &segments[i];
+            if (!setupLine(image, vertex, colour, l))
+            {
+                continue;
+            }
+            minX = l->minX, minY = l->minY, maxX = l->maxX, maxY = l->maxY;
+        }
+        else
+        {
+            RasterTriangle *t = &triangles[i];
+            if (!setupTriangle(image, vertex, colour, t))
+            {
+                continue;
+            }
+            minX = t->minX, minY = t->minY, maxX = t->maxX, maxY = t->maxY;
+        }
+
+        for (int ty = minY / RASTER_TILE_SIZE; ty <= maxY / RASTER_TILE_SIZE; ty++)
+        {
+            for (int tx = minX / RASTER_TILE_SIZE; tx <= maxX / RASTER_TILE_SIZE; tx++)
+            {
+                bins[ty * tilesX + tx].push_back(i);
+            }
+        }
+    }
+
+    // tiles are handed out one at a time, since the shapes cover some far more than others
+    atomic<int> nextTile(0);
+    atomic<long long> fragments(0);
+    auto rasterizeTiles = [&]()
+    {
+        long long covered = 0;
+        for (int tile = nextTile++; tile < (int)bins.size(); tile = nextTile++)
+        {
+            int x0 = (tile % tilesX) * RASTER_TILE_SIZE;
+            int y0 = (tile / tilesX) * RASTER_TILE_SIZE;
+            int x1 = min(x0 + RASTER_TILE_SIZE, image->width);
+            int y1 = min(y0 + RASTER_TILE_SIZE, image->height);
+            for (size_t i = 0; i < bins[tile].size(); i++)
+            {
+                int primitive = bins[tile][i];
+                covered += lines ? RasterizeLine(image, segments[primitive], x0, y0, x1, y1)
+                                 : RasterizeTriangle(image, triangles[primitive], x0, y0, x1, y1);
+            }
+        }
+        fragments += covered;
+    };
+
+    vector<thread> workers;
+    for (int i = 1; i < threads; i++)
+    {
+        workers.push_back(thread(rasterizeTiles));
+    }
+    rasterizeTiles();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    return fragments;
+}
+
+// --------------------------------------------------------------------------
+// Image files
+
+bool WriteRasterImage(const string &filename, const RasterImage &image)
+{
+    ofstream file(filename.c_str(), ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    for (int y = image.height - 1; y >= 0; y--)
+    {
+        file.write((const char *)&image.pixels[3 * (size_t)y * image.width], 3 * image.width);
+    }
+    return (bool)file;
+}
+
+bool ReadRasterImage(const string &filename, RasterImage *image)
+{
+    ifstream file(filename.c_str(), ios::binary);
+    string magic;
+    int maxValue;
+    file >> magic >> image->width >> image->height >> maxValue;
+    if (!file || magic != "P6" || maxValue != 255 || image->width <= 0 || image->height <= 0)
+    {
+        return false;
+    }
+    file.get();
+
+    image->pixels.resize((size_t)image->width * image->height * 3);
+    for (int y = image->height - 1; y >= 0; y--)
+    {
+        file.read((char *)&image->pixels[3 * (size_t)y * image->width], 3 * image->width);
+    }
+    return (bool)file;
+}
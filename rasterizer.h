@@ -0,0 +1,36 @@
+// ==========================================================================
+// Software rasterizer for the vertex and colour arrays of the generators.
+// It draws GL_TRIANGLES and GL_LINES the way vertex.glsl and fragment.glsl
+// do, with colours interpolated between the vertices. It needs no OpenGL
+// context, so it serves as a reference renderer on machines without a GPU.
+// The frame is split into tiles that are rasterized on separate threads.
+// ==========================================================================
+
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <string>
+#include <vector>
+
+// Side of the square tiles the frame is split into, in pixels
+const int RASTER_TILE_SIZE = 32;
+
+// RGB bytes of a frame, with the bottom row first like glReadPixels
+struct RasterImage
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+
+    RasterImage() : width(0), height(0)
+    {}
+};
+
+void ClearRasterImage(RasterImage *image, int width, int height, float red, float green, float blue);
+long long RasterizeArrays(RasterImage *image, bool lines, const float *vertices, const float *colours, int count, int threads);
+
+// Images are stored as binary PPM files, top row first
+bool WriteRasterImage(const std::string &filename, const RasterImage &image);
+bool ReadRasterImage(const std::string &filename, RasterImage *image);
+
+#endif
@@ -0,0 +1,364 @@
+// ==========================================================================
+// Draws the shapes with the software rasterizer, no OpenGL context is needed.
+//
+// Without options every part and level is rendered and written as a PPM
+// image. The images can be kept as golden images and later compared with
+// fresh renders, so that changes to the generators or the rasterizer that
+// alter a picture are caught. The benchmark times the rasterizer alone and
+// prints the pixels it writes per second, as CSV on standard output.
+// ==========================================================================
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "geometry.h"
+#include "rasterizer.h"
+
+using namespace std;
+
+const int PARTS = 3;
+
+// Vertices and colours of one shape, as the non-indexed render paths of main.cpp upload them
+struct SoftShape
+{
+    vector<float> vertices;
+    vector<float> colours;
+    bool lines;
+};
+
+void BuildShape(int part, int level, SoftShape *shape)
+{
+    shape->lines = part == 2;
+    if (part == 1)
+    {
+        shape->vertices.resize(SquareAndDiamondVertexCount(level) * 2);
+        shape->colours.resize(shape->vertices.size() / 2 * 3);
+        SetupVertexBufferSquareAndDiamond(0, level, shape->vertices.data(), false);
+        SetupColourBufferSquareAndDiamond(0, level, shape->colours.data(), false);
+    }
+    else if (part == 2)
+    {
+        shape->vertices.resize(SpiralSampleCount(level) * 4);
+        shape->colours.resize(shape->vertices.size() / 2 * 3);
+        EvaluateSpiral(shape->vertices.data(), level);
+        AssignSpiralColours(shape->colours.data(), level, 0);
+    }
+    else
+    {
+        long long groups = SierpinskiGroupCount(level, SIERPINSKI_BYTES_PER_GROUP);
+        shape->vertices.resize(groups * SIERPINSKI_VERTEX_FLOATS);
+        shape->colours.resize(groups * SIERPINSKI_COLOUR_FLOATS);
+        GenerateSierpinski(shape->vertices.data(), shape->colours.data(), 0, -0.8f, -0.6f, 0.8f, -0.6f, 0.0f, 0.8f, level, false, 0);
+    }
+}
+
+// Vertices and colours of a spiral sampled for a square image of the given size, as the adaptive
+// spiral mode of main.cpp builds them
+void BuildAdaptiveSpiral(int level, int size, float targetPixels, SoftShape *shape)
+{
+    vector<float> samples;
+    AdaptiveSpiralSamples(level, size * 0.5f, targetPixels, &samples);
+    shape->lines = true;
+    shape->vertices.resize(samples.size() * 4);
+    shape->colours.resize(samples.size() * 6);
+    EvaluateSpiralSamples(shape->vertices.data(), samples.data(), (int)samples.size(), level);
+    AssignSpiralSampleColours(shape->colours.data(), samples.data(), (int)samples.size(), level);
+}
+
+// Renders a shape on the background main.cpp clears to, returns the number of pixels written
+long long RenderShape(const SoftShape &shape, RasterImage *image, int width, int height, int threads)
+{
+    ClearRasterImage(image, width, height, 0.2f, 0.2f, 0.2f);
+    return RasterizeArrays(image, shape.lines, shape.vertices.data(), shape.colours.data(),
+                           (int)(shape.vertices.size() / 2), threads);
+}
+
+string GoldenFilename(const string &directory, int part, int level)
+{
+    ostringstream name;
+    name << directory << "/part" << part << "_level" << level << ".ppm";
+    return name.str();
+}
+
+// Writes, or compares against, the golden image of every part and level. Channels may differ by one
+// step, as the rounding of the interpolated colours is allowed to change with the compiler
+int RunGolden(const string &directory, bool write, int maxLevel, int width, int height, int threads)
+{
+    const int TOLERANCE = 1;
+    int failures = 0;
+    for (int part = 1; part <= PARTS; part++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            SoftShape shape;
+            RasterImage image;
+            BuildShape(part, level, &shape);
+            RenderShape(shape, &image, width, height, threads);
+            string filename = GoldenFilename(directory, part, level);
+            if (write)
+            {
+                if (!WriteRasterImage(filename, image))
+                {
+                    cerr << "Could not write " << filename << endl;
+                    return 1;
+                }
+                continue;
+            }
+
+            RasterImage golden;
+            if (!ReadRasterImage(filename, &golden))
+            {
+                cout << filename << ": missing" << endl;
+                failures++;
+                continue;
+            }
+            if (golden.width != image.width || golden.height != image.height)
+            {
+                cout << filename << ": " << golden.width << "x" << golden.height << " instead of "
+                     << image.width << "x" << image.height << endl;
+                failures++;
+                continue;
+            }
+            long long different = 0;
+            int largest = 0;
+            for (size_t i = 0; i < image.pixels.size(); i++)
+            {
+                int difference = abs((int)image.pixels[i] - (int)golden.pixels[i]);
+                largest = max(largest, difference);
+                different += difference > TOLERANCE;
+            }
+            cout << filename << ": " << (different == 0 ? "ok" : "different") << ", " << different
+                 << " channels differ by more than " << TOLERANCE << ", largest difference " << largest << endl;
+            failures += different > 0;
+        }
+    }
+    if (!write)
+    {
+        cout << failures << " of " << PARTS * maxLevel << " images differ from the golden images" << endl;
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// Compares the adaptive spiral with the fixed step one at every level, printing one CSV row with the
+// vertices of both and the pixels of the image that differ by more than one step
+void RunSpiralError(int maxLevel, int width, int height, int threads, float targetPixels)
+{
+    const int TOLERANCE = 1;
+    cout.setf(ios::fixed);
+    cout.precision(3);
+    cout << "level,width,height,target_pixels,dense_vertices,adaptive_vertices,vertex_ratio,spiral_pixels,"
+         << "different_pixels,largest_difference" << endl;
+    for (int level = 1; level <= maxLevel; level++)
+    {
+        SoftShape dense, adaptive;
+        RasterImage denseImage, adaptiveImage, background;
+        BuildShape(2, level, &dense);
+        BuildAdaptiveSpiral(level, max(width, height), targetPixels, &adaptive);
+        RenderShape(dense, &denseImage, width, height, threads);
+        RenderShape(adaptive, &adaptiveImage, width, height, threads);
+        ClearRasterImage(&background, width, height, 0.2f, 0.2f, 0.2f);
+
+        long long spiralPixels = 0;
+        long long different = 0;
+        int largest = 0;
+        for (size_t i = 0; i < denseImage.pixels.size(); i += 3)
+        {
+            int difference = 0;
+            bool covered = false;
+            for (int c = 0; c < 3; c++)
+            {
+                difference = max(difference, abs((int)denseImage.pixels[i + c] - (int)adaptiveImage.pixels[i + c]));
+                covered = covered || denseImage.pixels[i + c] != background.pixels[i + c];
+            }
+            largest = max(largest, difference);
+            different += difference > TOLERANCE;
+            spiralPixels += covered;
+        }
+        long long denseVertices = dense.vertices.size() / 2;
+        long long adaptiveVertices = adaptive.vertices.size() / 2;
+        cout << level << "," << width << "," << height << "," << targetPixels << "," << denseVertices << ","
+             << adaptiveVertices << "," << (double)adaptiveVertices / denseVertices << "," << spiralPixels << ","
+             << different << "," << largest << endl;
+    }
+}
+
+// Compares the spiral with the stacked one the program first generated, StackedSpiralReference(), at
+// every level. The positions and colours are checked against the visible last copy, the images are
+// rendered with every copy as the old program drew them. Prints one CSV row per level and returns one
+// if any position strays further than POSITION_TOLERANCE or any channel by more than one step
+int RunCompareSpiral(int maxLevel, int width, int height, int threads)
+{
+    const int TOLERANCE = 1;
+    const float POSITION_TOLERANCE = 1.0e-5f;
+    int failures = 0;
+    cout << "level,vertices,reference_vertices,largest_position_difference,largest_colour_difference,"
+         << "different_channels,largest_difference" << endl;
+    for (int level = 1; level <= maxLevel; level++)
+    {
+        SoftShape shape, reference;
+        RasterImage image, referenceImage;
+        BuildShape(2, level, &shape);
+        reference.lines = true;
+        StackedSpiralReference(level, &reference.vertices, &reference.colours);
+        // the colour loop of the reference runs one vertex past the end
+        reference.colours.resize(reference.vertices.size() / 2 * 3);
+
+        size_t vertices = shape.vertices.size() / 2;
+        size_t hidden = reference.vertices.size() / 2 - vertices;
+        float positionDifference = 0.0f;
+        float colourDifference = 0.0f;
+        for (size_t i = 0; i < vertices * 2; i++)
+        {
+            positionDifference = max(positionDifference, fabsf(shape.vertices[i] - reference.vertices[hidden * 2 + i]));
+        }
+        for (size_t i = 0; i < vertices * 3; i++)
+        {
+            colourDifference = max(colourDifference, fabsf(shape.colours[i] - reference.colours[hidden * 3 + i]));
+        }
+
+        RenderShape(shape, &image, width, height, threads);
+        RenderShape(reference, &referenceImage, width, height, threads);
+        long long different = 0;
+        int largest = 0;
+        for (size_t i = 0; i < image.pixels.size(); i++)
+        {
+            int difference = abs((int)image.pixels[i] - (int)referenceImage.pixels[i]);
+            largest = max(largest, difference);
+            different += difference > TOLERANCE;
+        }
+        cout << level << "," << vertices << "," << reference.vertices.size() / 2 << "," << positionDifference << ","
+             << colourDifference << "," << different << "," << largest << endl;
+        failures += positionDifference > POSITION_TOLERANCE || different > 0;
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+// Times the rasterizer alone on every part and level, the shapes are built once beforehand
+void RunBenchmark(int maxLevel, int width, int height, int threads, double minimumSeconds)
+{
+    const int MINIMUM_FRAMES = 3;
+    cout.setf(ios::fixed);
+    cout.precision(3);
+    cout << "part,level,width,height,threads,pixels,ms_per_frame,mpixels_per_second" << endl;
+    for (int part = 1; part <= PARTS; part++)
+    {
+        for (int level = 1; level <= maxLevel; level++)
+        {
+            SoftShape shape;
+            RasterImage image;
+            BuildShape(part, level, &shape);
+            long long pixels = 0;
+            double best = 0.0;
+            double total = 0.0;
+            for (int frames = 0; frames < MINIMUM_FRAMES || total < minimumSeconds; frames++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                pixels = RenderShape(shape, &image, width, height, threads);
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                best = frames == 0 ? elapsed : min(best, elapsed);
+                total += elapsed;
+            }
+            cout << part << "," << level << "," << width << "," << height << "," << threads << "," << pixels << ","
+                 << best * 1.0e3 << "," << pixels / best * 1.0e-6 << endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    string writeDirectory;
+    string checkDirectory;
+    bool benchmark = false;
+    bool spiralError = false;
+    bool compareSpiral = false;
+    float spiralPixels = 0.7f;
+    int maxLevel = 6;
+    int width = 512;
+    int height = 512;
+    int threads = max(1, (int)thread::hardware_concurrency());
+    double minimumSeconds = 0.2;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option.compare(0, 15, "--write-golden=") == 0)
+        {
+            writeDirectory = option.substr(15);
+        }
+        else if (option.compare(0, 15, "--check-golden=") == 0)
+        {
+            checkDirectory = option.substr(15);
+        }
+        else if (option == "--benchmark")
+        {
+            benchmark = true;
+        }
+        else if (option == "--spiral-error")
+        {
+            spiralError = true;
+        }
+        else if (option == "--compare-spiral")
+        {
+            compareSpiral = true;
+        }
+        else if (option.compare(0, 16, "--spiral-pixels=") == 0)
+        {
+            spiralPixels = atof(option.substr(16).c_str());
+        }
+        else if (option.compare(0, 12, "--max-level=") == 0)
+        {
+            maxLevel = atoi(option.substr(12).c_str());
+        }
+        else if (option.compare(0, 7, "--size=") == 0)
+        {
+            width = height = atoi(option.substr(7).c_str());
+        }
+        else if (option.compare(0, 10, "--threads=") == 0)
+        {
+            threads = max(1, atoi(option.substr(10).c_str()));
+        }
+        else if (option.compare(0, 14, "--min-seconds=") == 0)
+        {
+            minimumSeconds = atof(option.substr(14).c_str());
+        }
+        else
+        {
+            cout << "Unknown option " << option << endl;
+            cout << "Usage: softrender [--write-golden=<directory> | --check-golden=<directory> | --benchmark" << endl
+                 << "                  | --spiral-error | --compare-spiral] [--max-level=<level>] [--size=<pixels>] [--threads=<threads>]" << endl
+                 << "                  [--min-seconds=<seconds per level>] [--spiral-pixels=<pixels per segment>]" << endl;
+            return -1;
+        }
+    }
+    if (width <= 0 || maxLevel <= 0 || spiralPixels <= 0.0f)
+    {
+        cout << "The size, the maximum level and the pixels per spiral segment must be positive" << endl;
+        return -1;
+    }
+
+    if (benchmark)
+    {
+        RunBenchmark(maxLevel, width, height, threads, minimumSeconds);
+        return 0;
+    }
+    if (spiralError)
+    {
+        RunSpiralError(maxLevel, width, height, threads, spiralPixels);
+        return 0;
+    }
+    if (compareSpiral)
+    {
+        return RunCompareSpiral(maxLevel, width, height, threads);
+    }
+    if (!checkDirectory.empty())
+    {
+        return RunGolden(checkDirectory, false, maxLevel, width, height, threads);
+    }
+    return RunGolden(writeDirectory.empty() ? "." : writeDirectory, true, maxLevel, width, height, threads);
+}
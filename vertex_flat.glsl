@@ -0,0 +1,25 @@
+// ==========================================================================
+// Vertex program for vertices shared by triangles of different colours
+//
+// Same as vertex.glsl, but the colour is not interpolated: each triangle
+// takes the colour of its last vertex, so the index buffer can reuse the
+// other corners whatever their colour is
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeGeometry() function of the main program
+layout(location = 0) in vec2 VertexPosition;
+layout(location = 1) in vec3 VertexColour;
+
+// output passed unchanged from the provoking vertex to the fragment stage
+flat out vec3 Colour;
+
+void main()
+{
+    // assign vertex position without modification
+    gl_Position = vec4(VertexPosition, 0.0, 1.0);
+
+    // assign output colour, only used if this is the last vertex of the triangle
+    Colour = VertexColour;
+}
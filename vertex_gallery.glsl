@@ -0,0 +1,40 @@
+// ==========================================================================
+// Vertex program for the gallery of every part and level
+//
+// The shapes are stored one after another in the same buffers and drawn
+// together, the tile of each vertex is found from its index
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// BuildGallery() function of the main program
+layout(location = 0) in vec2 VertexPosition;
+layout(location = 1) in vec3 VertexColour;
+
+const int MAX_TILES = 32;
+uniform int TileCount;
+uniform int TileFirst[MAX_TILES];       // first vertex of each tile, in increasing order
+uniform vec4 TileTransform[MAX_TILES];  // scale of the shape in xy and its offset in zw
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Colour;
+
+void main()
+{
+    // gl_VertexID counts from the start of the buffers in every draw of a glMultiDrawArrays
+    int tile = 0;
+    for (int i = 1; i < TileCount; i++)
+    {
+        if (gl_VertexID >= TileFirst[i])
+        {
+            tile = i;
+        }
+    }
+
+    // move the shape into its tile
+    vec4 transform = TileTransform[tile];
+    gl_Position = vec4(VertexPosition * transform.xy + transform.zw, 0.0, 1.0);
+
+    // assign output colour to be interpolated
+    Colour = VertexColour;
+}
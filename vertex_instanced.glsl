@@ -0,0 +1,32 @@
+// ==========================================================================
+// Vertex program for the instanced Sierpinski triangle
+//
+// Every instance draws one subdivided triangle, placed and coloured by the
+// attributes of its subdivision
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeSierpinskiInstanced() function of the main program
+layout(location = 0) in vec4 VertexPosition;   // upright and listed from the top
+layout(location = 2) in vec2 InstanceOffset;
+layout(location = 3) in float InstanceScale;
+layout(location = 4) in vec3 InstanceRed;
+layout(location = 5) in vec3 InstanceCyan;
+layout(location = 6) in vec3 InstanceBlue;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Colour;
+
+void main()
+{
+    // move the subdivided unit triangle onto the triangle of this instance, a
+    // negative scale lists its corners starting from the top one
+    vec2 corner = InstanceScale < 0.0 ? VertexPosition.zw : VertexPosition.xy;
+    gl_Position = vec4(InstanceOffset + abs(InstanceScale) * corner, 0.0, 1.0);
+
+    // the inverted triangle comes first and is always white, followed by
+    // the left bottom, right bottom and top triangles
+    vec3 colours[4] = vec3[4](vec3(1.0), InstanceRed, InstanceCyan, InstanceBlue);
+    Colour = colours[gl_VertexID / 3];
+}
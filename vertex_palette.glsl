@@ -0,0 +1,156 @@
+// ==========================================================================
+// Vertex program computing the colours of the square and diamond and of the
+// Sierpinski triangle from gl_VertexID, so they need no colour buffer
+//
+// The colours are those the main program generates, bit for bit. Both
+// shapes only ever subtract or add a step to the colours of the level or
+// subdivision before, rounded to floats. The square and diamond steps are
+// replayed from the start colours of the Palette block. The Sierpinski
+// colours drift over every subdivision of the whole triangle, so the main
+// program hands over the colours at every CheckpointInterval-th subdivision
+// of each level and at most CheckpointInterval - 1 steps are replayed
+// ==========================================================================
+#version 410
+
+const int SIERPINSKI_LEVELS = 20;   // SIERPINSKI_PALETTE_LEVELS of the main program
+
+// location indices for these attributes correspond to those specified in the
+// SetupVertexArray() function of the main program
+layout(location = 0) in vec2 VertexPosition;
+
+layout(std140) uniform Palette
+{
+    vec4 SquareColour;                                  // outermost square and diamond
+    vec4 DiamondColour;
+    float LevelStep;                                    // subtracted for every level inside the square
+    float SierpinskiFactor[SIERPINSKI_LEVELS];          // drift of a triangle of one to SIERPINSKI_LEVELS iterations
+    double SierpinskiFactorSquared[SIERPINSKI_LEVELS];
+};
+
+uniform int Part;       // 1 for the square and diamond, 3 for the Sierpinski triangle
+uniform int Level;      // iterations of the Sierpinski triangle before any appended ones
+uniform samplerBuffer Checkpoints;  // red, cyan and blue, nine floats per checkpoint, for the triangle of
+                                    // one iteration, then for the one of two iterations and so on
+uniform int CheckpointInterval;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Colour;
+
+// Six vertices of the square of each level followed by six of its diamond, darker for every level inside
+vec3 SquareAndDiamondColour(int vertex)
+{
+    precise vec3 colour = vertex % 12 < 6 ? SquareColour.rgb : DiamondColour.rgb;
+    for (int level = vertex / 12; level > 0; level--)
+    {
+        colour = colour - LevelStep;
+    }
+    return colour;
+}
+
+// Index in depth first order of the leaf-th subdivision of the last iteration of a triangle with
+// the given number of subdivisions
+int LeafGroup(int leaf, int groups)
+{
+    int group = 0;
+    int size = groups;
+    int leaves = (2 * groups + 1) / 3;
+    while (size > 1)
+    {
+        size = (size - 1) / 3;
+        leaves = leaves / 3;
+        group += 1 + (leaf / leaves) * size;
+        leaf = leaf % leaves;
+    }
+    return group;
+}
+
+// First checkpoint of the triangle with the given number of iterations, the checkpoints of the
+// triangles with fewer iterations come before it
+int FirstCheckpoint(int level)
+{
+    int first = 0;
+    int groups = 0;
+    for (int n = 1; n < level; n++)
+    {
+        groups = 3 * groups + 1;
+        first += (groups + CheckpointInterval - 1) / CheckpointInterval;
+    }
+    return first;
+}
+
+// Colour of the outer triangles of a subdivision as driftSierpinskiColours() in the main program leaves
+// it: triangle 0, 1 or 2 for red, cyan or blue. The drift is replayed from the checkpoint before it
+vec3 SubdivisionColour(int group, int level, int triangle)
+{
+    float factor = SierpinskiFactor[level - 1];
+    double factorSquared = SierpinskiFactorSquared[level - 1];
+    int checkpoint = 9 * (FirstCheckpoint(level) + group / CheckpointInterval);
+    precise float redR = texelFetch(Checkpoints, checkpoint).r;
+    precise float redG = texelFetch(Checkpoints, checkpoint + 1).r;
+    precise float redB = texelFetch(Checkpoints, checkpoint + 2).r;
+    precise float greenR = texelFetch(Checkpoints, checkpoint + 3).r;
+    precise float greenG = texelFetch(Checkpoints, checkpoint + 4).r;
+    precise float greenB = texelFetch(Checkpoints, checkpoint + 5).r;
+    precise float blueR = texelFetch(Checkpoints, checkpoint + 6).r;
+    precise float blueG = texelFetch(Checkpoints, checkpoint + 7).r;
+    precise float blueB = texelFetch(Checkpoints, checkpoint + 8).r;
+    for (int i = group - group % CheckpointInterval; i < group; i++)
+    {
+        // driftSierpinskiColours(), the mixed precision is part of the result
+        precise double alternate = (i % 2 == 0) ? 1.0LF : -1.0LF;
+        redR = float(double(redR) - factorSquared);
+        redG = redG + factor;
+        redB = redB + factor / 2.0;
+        greenR = greenR + factor;
+        greenG = float(double(greenR) - (double(factor) + 0.1LF * alternate));
+        greenB = greenB + factor / 2.0;
+        blueR = float(double(blueR) + (double(factor) + 0.1LF * alternate));
+        blueG = blueG + factor;
+        blueB = blueG - factor / 4.0;
+    }
+    vec3 triangleColours[3] = vec3[3](vec3(redR, redG, redB), vec3(greenR, greenG, greenB), vec3(blueR, blueG, blueB));
+    return triangleColours[triangle];
+}
+
+// Twelve vertices per subdivision: the white inverted triangle, then the red, cyan and blue ones
+vec3 SierpinskiColour(int vertex)
+{
+    int corner = vertex % 12;
+    if (corner < 3)
+    {
+        return vec3(1.0);
+    }
+
+    // the first Level iterations are in depth first order, each iteration appended after them only
+    // holds its own subdivisions, coloured as in a triangle of that many iterations
+    int subdivision = vertex / 12;
+    int level = Level;
+    int groups = 0;
+    for (int n = 0; n < Level; n++)
+    {
+        groups = 3 * groups + 1;
+    }
+    int group = subdivision;
+    if (subdivision >= groups)
+    {
+        int leaf = subdivision - groups;
+        int leaves = 2 * groups + 1;
+        level++;
+        while (leaf >= leaves)
+        {
+            leaf -= leaves;
+            leaves *= 3;
+            level++;
+        }
+        group = LeafGroup(leaf, (3 * leaves - 1) / 2);
+    }
+    return SubdivisionColour(group, level, corner / 3 - 1);
+}
+
+void main()
+{
+    // assign vertex position without modification
+    gl_Position = vec4(VertexPosition, 0.0, 1.0);
+
+    Colour = Part == 1 ? SquareAndDiamondColour(gl_VertexID) : SierpinskiColour(gl_VertexID);
+}
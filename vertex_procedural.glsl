@@ -0,0 +1,85 @@
+// ==========================================================================
+// Vertex program for the Sierpinski triangle generated without vertex buffers
+//
+// gl_VertexID is decoded into the path through the subdivisions, in the same
+// depth first order as renderTriangleLevel() in the main program
+// ==========================================================================
+#version 410
+
+uniform vec2 BaseTriangle[3];   // corners of the first iteration
+uniform int Level;              // number of iterations
+uniform vec3 Palette[3];        // red, cyan and blue triangles of the first subdivision
+uniform float Alternate;        // colour change that alternates sign every subdivision
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Colour;
+
+void main()
+{
+    // every subdivision draws four triangles of three vertices
+    int triangle = gl_VertexID / 3;
+    int group = triangle / 4;
+    int piece = triangle % 4;
+
+    // number of subdivisions below the current triangle, including itself
+    int size = 1;
+    for (int i = 1; i < Level; i++)
+    {
+        size = size * 3 + 1;
+    }
+
+    // follow the base-3 path from the base triangle down to the subdivision
+    vec2 p1 = BaseTriangle[0];
+    vec2 p2 = BaseTriangle[1];
+    vec2 p3 = BaseTriangle[2];
+    int index = group;
+    while (index > 0)
+    {
+        index -= 1;
+        size = (size - 1) / 3;
+        int child = index / size;
+        index = index % size;
+
+        vec2 m1 = (p1 + p2) / 2.0;
+        vec2 m2 = (p3 + p2) / 2.0;
+        vec2 m3 = (p3 + p1) / 2.0;
+        if (child == 0)
+        {
+            p2 = m1;
+            p3 = m3;
+        }
+        else if (child == 1)
+        {
+            p1 = m1;
+            p3 = m2;
+        }
+        else
+        {
+            p1 = p3;
+            p2 = m2;
+            p3 = m3;
+        }
+    }
+
+    // inverted triangle, then left bottom, right bottom and top triangles
+    vec2 m1 = (p1 + p2) / 2.0;
+    vec2 m2 = (p3 + p2) / 2.0;
+    vec2 m3 = (p3 + p1) / 2.0;
+    vec2 corners[12] = vec2[12](m1, m2, m3, p1, m1, m3, m1, p2, m2, m3, m2, p3);
+    gl_Position = vec4(corners[gl_VertexID % 12], 0.0, 1.0);
+
+    // colours drift by a fixed step every subdivision, as in assignColoursToLevelSierpinski()
+    float factor = 1.0 / (float(Level) * 72.0);
+    float n = float(group);
+    bool odd = (group % 2) == 1;
+    vec3 red = Palette[0] + n * vec3(-factor * factor, factor, factor / 2.0);
+    vec3 cyan = Palette[1] + n * vec3(factor, 0.0, factor / 2.0);
+    vec3 blue = Palette[2] + n * vec3(factor, factor, 0.0) + vec3(odd ? Alternate : 0.0, 0.0, 0.0);
+    if (group > 0)
+    {
+        cyan.g = cyan.r - (factor + (odd ? Alternate : -Alternate));
+        blue.b = blue.g - factor / 4.0;
+    }
+    vec3 colours[4] = vec3[4](vec3(1.0), red, cyan, blue);
+    Colour = colours[piece];
+}
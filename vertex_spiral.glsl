@@ -0,0 +1,45 @@
+// ==========================================================================
+// Vertex program for the spiral with its colour ramp computed per vertex
+//
+// Same ramp as SpiralColour() in the main program, so the spiral needs no
+// colour buffer
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeSpirals() function of the main program
+layout(location = 0) in vec2 VertexPosition;
+
+uniform int Level;              // number of revolutions
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec3 Colour;
+
+void main()
+{
+    // assign vertex position without modification
+    gl_Position = vec4(VertexPosition, 0.0, 1.0);
+
+    // the ramp spans 3.5 channel changes and starts where the last of the
+    // copies the spiral used to be drawn with started
+    int vertices = 400 * Level * 4 * 2;
+    float step = 3.5 / float(vertices);
+    int phaseLength = 2 * vertices / 7 + 1;
+    int i = gl_VertexID + (Level - 1) * vertices;
+
+    // red, green and then blue go from one down to zero and back up again
+    int phase = i / phaseLength;
+    int t = i % phaseLength + 1;
+    int channel = phase % 3;
+    bool descending = phase % 6 < 3;
+    float before = descending ? 0.0 : 1.0;
+    float after = descending ? 1.0 : 0.0;
+    float current = t == phaseLength ? before : (descending ? 1.0 - float(t) * step : float(t) * step);
+
+    vec3 colour;
+    for (int c = 0; c < 3; c++)
+    {
+        colour[c] = c < channel ? before : (c > channel ? after : current);
+    }
+    Colour = colour;
+}
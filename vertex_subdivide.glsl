@@ -0,0 +1,105 @@
+// ==========================================================================
+// Vertex program adding one iteration to a Sierpinski triangle on the GPU
+//
+// Drawn as points with the rasterizer discarded, every vertex is captured by
+// transform feedback. gl_VertexID is one vertex of one subdivision of the
+// new iteration: each outer triangle of a subdivision of the last iteration
+// is subdivided once more, in the order and with the corners that
+// GenerateSierpinskiLeaves() in the main program gives the new subdivisions.
+// Their colours drift with every subdivision of the whole triangle, which
+// depends on the rounding of all the steps before, so the main program
+// hands over the colours at every CheckpointInterval-th subdivision and the
+// drift of driftSierpinskiColours() is replayed from the one before
+// ==========================================================================
+#version 410
+
+uniform samplerBuffer Parents;      // positions of the triangle so far, two floats per vertex
+uniform int ParentFirst;            // first vertex of the last iteration when it was appended to the triangle
+uniform int ParentGroups;           // subdivisions of the triangle when the last iteration is not appended, else 0
+uniform int Groups;                 // subdivisions of the triangle with the new iteration
+uniform samplerBuffer Checkpoints;  // red, cyan and blue, nine floats per checkpoint
+uniform int CheckpointInterval;
+uniform float Factor;               // colour drift of one subdivision
+uniform double FactorSquared;
+
+// captured into the vertex and colour buffers of the triangle
+out vec2 Position;
+out vec3 Colour;
+
+// Index in depth first order of the leaf-th subdivision of the last iteration of a triangle with
+// the given number of subdivisions
+int LeafGroup(int leaf, int groups)
+{
+    int group = 0;
+    int size = groups;
+    int leaves = (2 * groups + 1) / 3;
+    while (size > 1)
+    {
+        size = (size - 1) / 3;
+        leaves = leaves / 3;
+        group += 1 + (leaf / leaves) * size;
+        leaf = leaf % leaves;
+    }
+    return group;
+}
+
+vec2 ParentCorner(int vertex)
+{
+    return texelFetch(Parents, vertex).xy;
+}
+
+void main()
+{
+    int subdivision = gl_VertexID / 12;
+    int corner = gl_VertexID % 12;
+
+    // the outer triangles of a subdivision come after its inverted one; the top one is stored from its
+    // last corner, the reverse of the order it is subdivided in
+    int parent = subdivision / 3;
+    int child = subdivision % 3;
+    int first = ParentGroups > 0 ? 12 * LeafGroup(parent, ParentGroups) : ParentFirst + 12 * parent;
+    first += 3 + 3 * child;
+    vec2 p1 = ParentCorner(child == 2 ? first + 2 : first);
+    vec2 p2 = ParentCorner(first + 1);
+    vec2 p3 = ParentCorner(child == 2 ? first : first + 2);
+
+    // inverted triangle, then left bottom, right bottom and top triangles
+    precise vec2 m1 = (p1 + p2) / 2.0;
+    precise vec2 m2 = (p3 + p2) / 2.0;
+    precise vec2 m3 = (p3 + p1) / 2.0;
+    vec2 corners[12] = vec2[12](m1, m2, m3, p1, m1, m3, m1, p2, m2, m3, m2, p3);
+    Position = corners[corner];
+    if (corner < 3)
+    {
+        Colour = vec3(1.0);
+        return;
+    }
+
+    int group = LeafGroup(subdivision, Groups);
+    int checkpoint = group / CheckpointInterval;
+    precise float redR = texelFetch(Checkpoints, 9 * checkpoint).r;
+    precise float redG = texelFetch(Checkpoints, 9 * checkpoint + 1).r;
+    precise float redB = texelFetch(Checkpoints, 9 * checkpoint + 2).r;
+    precise float greenR = texelFetch(Checkpoints, 9 * checkpoint + 3).r;
+    precise float greenG = texelFetch(Checkpoints, 9 * checkpoint + 4).r;
+    precise float greenB = texelFetch(Checkpoints, 9 * checkpoint + 5).r;
+    precise float blueR = texelFetch(Checkpoints, 9 * checkpoint + 6).r;
+    precise float blueG = texelFetch(Checkpoints, 9 * checkpoint + 7).r;
+    precise float blueB = texelFetch(Checkpoints, 9 * checkpoint + 8).r;
+    for (int i = checkpoint * CheckpointInterval; i < group; i++)
+    {
+        // driftSierpinskiColours(), the mixed precision is part of the result
+        precise double alternate = (i % 2 == 0) ? 1.0LF : -1.0LF;
+        redR = float(double(redR) - FactorSquared);
+        redG = redG + Factor;
+        redB = redB + Factor / 2.0;
+        greenR = greenR + Factor;
+        greenG = float(double(greenR) - (double(Factor) + 0.1LF * alternate));
+        greenB = greenB + Factor / 2.0;
+        blueR = float(double(blueR) + (double(Factor) + 0.1LF * alternate));
+        blueG = blueG + Factor;
+        blueB = blueG - Factor / 4.0;
+    }
+    vec3 triangleColours[3] = vec3[3](vec3(redR, redG, redB), vec3(greenR, greenG, greenB), vec3(blueR, blueG, blueB));
+    Colour = triangleColours[corner / 3 - 1];
+}